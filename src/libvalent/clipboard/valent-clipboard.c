@@ -24,14 +24,34 @@
  * Plugins can implement [class@Valent.ClipboardAdapter] to provide an interface
  * to access a clipboard selection.
  *
+ * Text content is read from the adapter at most once per change, with
+ * concurrent callers of [method@Valent.Clipboard.read_text] sharing the result.
+ * A cancelled caller is completed immediately, while the read continues for
+ * the others.
+ *
  * Since: 1.0
  */
 
+typedef struct
+{
+  ValentClipboard *clipboard;
+  int64_t          timestamp;
+  const char      *mimetype;
+  GPtrArray       *tasks;
+  GPtrArray       *sources;
+} TextRequest;
+
 struct _ValentClipboard
 {
   ValentComponent         parent_instance;
 
   ValentClipboardAdapter *default_adapter;
+
+  /* Text content, keyed by timestamp and mime-type */
+  TextRequest            *text_request;
+  char                   *text;
+  const char             *text_mimetype;
+  int64_t                 text_timestamp;
 };
 
 G_DEFINE_FINAL_TYPE (ValentClipboard, valent_clipboard, VALENT_TYPE_COMPONENT)
@@ -94,14 +114,89 @@ valent_clipboard_adapter_write_bytes_cb (ValentClipboardAdapter *adapter,
   g_task_return_boolean (task, TRUE);
 }
 
+static void
+text_request_source_free (gpointer data)
+{
+  GSource *source = data;
+
+  if (source != NULL)
+    {
+      g_source_destroy (source);
+      g_source_unref (source);
+    }
+}
+
+static void
+text_request_free (gpointer data)
+{
+  TextRequest *request = data;
+
+  g_clear_object (&request->clipboard);
+  g_clear_pointer (&request->sources, g_ptr_array_unref);
+  g_clear_pointer (&request->tasks, g_ptr_array_unref);
+  g_free (request);
+}
+
+static gboolean
+text_request_cancelled_cb (GCancellable *cancellable,
+                           gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  TextRequest *request = g_task_get_task_data (task);
+  unsigned int index;
+
+  if (g_ptr_array_find (request->tasks, task, &index))
+    {
+      g_task_return_error_if_cancelled (task);
+      g_ptr_array_remove_index (request->sources, index);
+      g_ptr_array_remove_index (request->tasks, index);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+text_request_add_task (TextRequest *request,
+                       GTask       *task)
+{
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  GSource *source = NULL;
+
+  /* Complete a cancelled caller promptly, without cancelling the shared read */
+  if (cancellable != NULL)
+    {
+      g_task_set_task_data (task, request, NULL);
+      source = g_cancellable_source_new (cancellable);
+      g_task_attach_source (task, source, G_SOURCE_FUNC (text_request_cancelled_cb));
+    }
+
+  g_ptr_array_add (request->sources, source);
+  g_ptr_array_add (request->tasks, g_object_ref (task));
+}
+
+/*
+ * Forget the cached text and detach any pending read, so that it completes its
+ * waiting tasks without updating the cache.
+ */
+static void
+valent_clipboard_clear_text (ValentClipboard *self)
+{
+  self->text_request = NULL;
+  g_clear_pointer (&self->text, g_free);
+  self->text_mimetype = NULL;
+  self->text_timestamp = 0;
+}
+
 static void
 valent_clipboard_adapter_read_text_cb (ValentClipboardAdapter *adapter,
                                        GAsyncResult           *result,
                                        gpointer                user_data)
 {
-  g_autoptr (GTask) task = G_TASK (user_data);
+  TextRequest *request = user_data;
+  ValentClipboard *self = request->clipboard;
   g_autoptr (GError) error = NULL;
   g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *text = NULL;
   const char *data = NULL;
   size_t size;
 
@@ -110,15 +205,42 @@ valent_clipboard_adapter_read_text_cb (ValentClipboardAdapter *adapter,
 
   bytes = valent_clipboard_adapter_read_bytes_finish (adapter, result, &error);
 
-  if (bytes == NULL)
-    return g_task_return_error (task, g_steal_pointer (&error));
+  if (bytes != NULL)
+    {
+      data = g_bytes_get_data (bytes, &size);
+
+      if (size > 0 && data[size - 1] == '\0')
+        text = g_strdup (data);
+      else
+        text = g_strndup (data, size);
+    }
 
-  data = g_bytes_get_data (bytes, &size);
+  if (self->text_request == request)
+    {
+      self->text_request = NULL;
 
-  if (size > 0 && data[size - 1] == '\0')
-    g_task_return_pointer (task, g_strdup (data), g_free);
-  else
-    g_task_return_pointer (task, g_strndup (data, size), g_free);
+      if (text != NULL)
+        {
+          g_clear_pointer (&self->text, g_free);
+          self->text = g_strdup (text);
+          self->text_mimetype = request->mimetype;
+          self->text_timestamp = request->timestamp;
+        }
+    }
+
+  g_ptr_array_set_size (request->sources, 0);
+
+  for (unsigned int i = 0; i < request->tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (request->tasks, i);
+
+      if (text != NULL)
+        g_task_return_pointer (task, g_strdup (text), g_free);
+      else
+        g_task_return_error (task, g_error_copy (error));
+    }
+
+  text_request_free (request);
 }
 
 static void
@@ -128,7 +250,10 @@ on_clipboard_adapter_changed (ValentClipboardAdapter *clipboard,
   VALENT_ENTRY;
 
   if (self->default_adapter == clipboard)
-    g_signal_emit (G_OBJECT (self), signals [CHANGED], 0);
+    {
+      valent_clipboard_clear_text (self);
+      g_signal_emit (G_OBJECT (self), signals [CHANGED], 0);
+    }
 
   VALENT_EXIT;
 }
@@ -148,6 +273,8 @@ valent_clipboard_bind_preferred (ValentComponent *component,
   g_assert (VALENT_IS_CLIPBOARD (self));
   g_assert (adapter == NULL || VALENT_IS_CLIPBOARD_ADAPTER (adapter));
 
+  valent_clipboard_clear_text (self);
+
   if (self->default_adapter != NULL)
     {
       g_signal_handlers_disconnect_by_func (self->default_adapter,
@@ -171,11 +298,24 @@ valent_clipboard_bind_preferred (ValentComponent *component,
 /*
  * GObject
  */
+static void
+valent_clipboard_finalize (GObject *object)
+{
+  ValentClipboard *self = VALENT_CLIPBOARD (object);
+
+  valent_clipboard_clear_text (self);
+
+  G_OBJECT_CLASS (valent_clipboard_parent_class)->finalize (object);
+}
+
 static void
 valent_clipboard_class_init (ValentClipboardClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   ValentComponentClass *component_class = VALENT_COMPONENT_CLASS (klass);
 
+  object_class->finalize = valent_clipboard_finalize;
+
   component_class->bind_preferred = valent_clipboard_bind_preferred;
 
   /**
@@ -451,6 +591,10 @@ valent_clipboard_write_bytes_finish (ValentClipboard  *clipboard,
  *
  * Get the text content of the primary clipboard adapter.
  *
+ * The content is read from the adapter once for each change, and concurrent
+ * calls share the same read. If @cancellable is triggered, this call completes
+ * with %G_IO_ERROR_CANCELLED without interrupting the read for other callers.
+ *
  * Call [method@Valent.Clipboard.read_text_finish] to get the result.
  *
  * Since: 1.0
@@ -464,6 +608,8 @@ valent_clipboard_read_text (ValentClipboard     *clipboard,
   g_autoptr (GTask) task = NULL;
   g_auto (GStrv) mimetypes = NULL;
   const char *mimetype = NULL;
+  TextRequest *request = NULL;
+  int64_t timestamp;
 
   VALENT_ENTRY;
 
@@ -505,11 +651,44 @@ valent_clipboard_read_text (ValentClipboard     *clipboard,
 
   task = g_task_new (clipboard, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_clipboard_read_text);
+
+  if (g_task_return_error_if_cancelled (task))
+    VALENT_EXIT;
+
+  /* Return the cached content, or join a read already in progress */
+  timestamp = valent_clipboard_adapter_get_timestamp (clipboard->default_adapter);
+
+  if (clipboard->text != NULL &&
+      clipboard->text_timestamp == timestamp &&
+      clipboard->text_mimetype == mimetype)
+    {
+      g_task_return_pointer (task, g_strdup (clipboard->text), g_free);
+      VALENT_EXIT;
+    }
+
+  if (clipboard->text_request != NULL &&
+      clipboard->text_request->timestamp == timestamp &&
+      clipboard->text_request->mimetype == mimetype)
+    {
+      text_request_add_task (clipboard->text_request, task);
+      VALENT_EXIT;
+    }
+
+  /* The read is shared, so callers are cancelled individually */
+  request = g_new0 (TextRequest, 1);
+  request->clipboard = g_object_ref (clipboard);
+  request->timestamp = timestamp;
+  request->mimetype = mimetype;
+  request->tasks = g_ptr_array_new_with_free_func (g_object_unref);
+  request->sources = g_ptr_array_new_with_free_func (text_request_source_free);
+  text_request_add_task (request, task);
+  clipboard->text_request = request;
+
   valent_clipboard_adapter_read_bytes (clipboard->default_adapter,
                                        mimetype,
-                                       cancellable,
+                                       NULL,
                                        (GAsyncReadyCallback)valent_clipboard_adapter_read_text_cb,
-                                       g_steal_pointer (&task));
+                                       request);
 
   VALENT_EXIT;
 }
@@ -183,14 +183,12 @@ valent_contact_cache_get_contact_task (GTask        *task,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  valent_object_lock (VALENT_OBJECT (self));
   e_book_cache_get_contact (self->cache,
                             uid,
                             FALSE,
                             &contact,
                             cancellable,
                             &error);
-  valent_object_unlock (VALENT_OBJECT (self));
 
   if (error != NULL)
     return g_task_return_error (task, error);
@@ -232,14 +230,14 @@ valent_contact_cache_query_task (GTask        *task,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  valent_object_lock (VALENT_OBJECT (self));
+  /* EBookCache serializes access internally, so readers don't take the
+   * object lock and don't wait on each other */
   e_book_cache_search (self->cache,
                        query,
                        FALSE,
                        &results,
                        cancellable,
                        &error);
-  valent_object_unlock (VALENT_OBJECT (self));
 
   if (error != NULL)
     return g_task_return_error (task, error);
@@ -276,6 +274,203 @@ valent_contact_cache_query (ValentContactStore  *store,
   g_task_run_in_thread (task, valent_contact_cache_query_task);
 }
 
+typedef struct
+{
+  char  *query;
+  char **fields;
+} QueryFieldsData;
+
+static void
+query_fields_data_free (gpointer data)
+{
+  QueryFieldsData *qdata = data;
+
+  g_clear_pointer (&qdata->query, g_free);
+  g_clear_pointer (&qdata->fields, g_strfreev);
+  g_free (qdata);
+}
+
+static inline gboolean
+vcard_line_matches (const char         *line,
+                    size_t              len,
+                    const char * const *fields)
+{
+  static const char * const required[] = {
+    "BEGIN", "VERSION", EVC_UID, "END", NULL,
+  };
+  size_t name_start = 0;
+  size_t name_end = 0;
+
+  /* The property name ends at the first parameter or value, after an
+   * optional group prefix (e.g. `item1.TEL`) */
+  while (name_end < len && line[name_end] != ';' && line[name_end] != ':')
+    {
+      if (line[name_end] == '.')
+        name_start = name_end + 1;
+
+      name_end++;
+    }
+
+  if (name_end == name_start)
+    return FALSE;
+
+  for (unsigned int i = 0; required[i] != NULL; i++)
+    {
+      if (strlen (required[i]) == name_end - name_start &&
+          g_ascii_strncasecmp (line + name_start, required[i], name_end - name_start) == 0)
+        return TRUE;
+    }
+
+  for (unsigned int i = 0; fields[i] != NULL; i++)
+    {
+      if (strlen (fields[i]) == name_end - name_start &&
+          g_ascii_strncasecmp (line + name_start, fields[i], name_end - name_start) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static inline gboolean
+vcard_line_is_quoted_printable (const char *line,
+                                size_t      len)
+{
+  static const char encoding[] = "QUOTED-PRINTABLE";
+  size_t params_end = 0;
+
+  /* The parameters end at the value, and may be `ENCODING=QUOTED-PRINTABLE`
+   * or the bare vCard 2.1 form `QUOTED-PRINTABLE` */
+  while (params_end < len && line[params_end] != ':')
+    params_end++;
+
+  for (size_t i = 0; i + strlen (encoding) <= params_end; i++)
+    {
+      if (g_ascii_strncasecmp (line + i, encoding, strlen (encoding)) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Copy the lines for @fields from @vcard, so the result can be parsed without
+ * paying for attributes the caller doesn't need, like an embedded photo.
+ */
+static char *
+valent_contact_cache_project_vcard (const char         *vcard,
+                                    const char * const *fields)
+{
+  GString *projected = g_string_new (NULL);
+  const char *line = vcard;
+  gboolean included = FALSE;
+  gboolean quoted_printable = FALSE;
+  gboolean soft_break = FALSE;
+
+  while (*line != '\0')
+    {
+      const char *eol = strchr (line, '\n');
+      size_t len = eol != NULL ? (size_t)(eol - line) : strlen (line);
+      gboolean folded;
+
+      if (len > 0 && line[len - 1] == '\r')
+        len--;
+
+      /* Folded lines (RFC 2425) and quoted-printable soft line breaks
+       * (vCard 2.1) continue the previous property */
+      folded = soft_break || line[0] == ' ' || line[0] == '\t';
+
+      if (!folded)
+        {
+          included = vcard_line_matches (line, len, fields);
+          quoted_printable = vcard_line_is_quoted_printable (line, len);
+        }
+
+      if (included)
+        {
+          g_string_append_len (projected, line, len);
+          g_string_append (projected, "\r\n");
+        }
+
+      /* Only a quoted-printable value has soft line breaks; a base64 value
+       * (e.g. `PHOTO;ENCODING=b`) may end in padding */
+      soft_break = quoted_printable && len > 0 && line[len - 1] == '=';
+
+      if (eol == NULL)
+        break;
+
+      line = eol + 1;
+    }
+
+  return g_string_free (projected, FALSE);
+}
+
+static void
+valent_contact_cache_query_fields_task (GTask        *task,
+                                        gpointer      source_object,
+                                        gpointer      task_data,
+                                        GCancellable *cancellable)
+{
+  ValentContactCache *self = VALENT_CONTACT_CACHE (source_object);
+  QueryFieldsData *qdata = task_data;
+  GSList *results = NULL;
+  GSList *contacts = NULL;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  e_book_cache_search (self->cache,
+                       qdata->query,
+                       FALSE,
+                       &results,
+                       cancellable,
+                       &error);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  for (const GSList *iter = results; iter; iter = iter->next)
+    {
+      EBookCacheSearchData *result = iter->data;
+      g_autofree char *vcard = NULL;
+      EContact *contact;
+
+      vcard = valent_contact_cache_project_vcard (result->vcard,
+                                                  (const char * const *)qdata->fields);
+      contact = e_contact_new_from_vcard_with_uid (vcard, result->uid);
+      contacts = g_slist_prepend (contacts, contact);
+    }
+  g_slist_free_full (results, e_book_cache_search_data_free);
+
+  g_task_return_pointer (task, contacts, object_slist_free);
+}
+
+static void
+valent_contact_cache_query_fields (ValentContactStore  *store,
+                                   const char          *query,
+                                   const char * const  *fields,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  QueryFieldsData *qdata = NULL;
+
+  g_assert (VALENT_IS_CONTACT_STORE (store));
+  g_assert (query != NULL);
+  g_assert (fields != NULL);
+  g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  qdata = g_new0 (QueryFieldsData, 1);
+  qdata->query = g_strdup (query);
+  qdata->fields = g_strdupv ((char **)fields);
+
+  task = g_task_new (store, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_contact_cache_query_fields);
+  g_task_set_task_data (task, qdata, query_fields_data_free);
+  g_task_run_in_thread (task, valent_contact_cache_query_fields_task);
+}
+
 /*
  * GObject
  */
@@ -377,6 +572,7 @@ valent_contact_cache_class_init (ValentContactCacheClass *klass)
   store_class->remove_contacts = valent_contact_cache_remove_contacts;
   store_class->query = valent_contact_cache_query;
   store_class->get_contact = valent_contact_cache_get_contact;
+  store_class->query_fields = valent_contact_cache_query_fields;
 
   /**
    * ValentContactCache:path:
@@ -35,6 +35,7 @@ G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (ValentContactStore, valent_contact_store, V
  * @get_contact: the virtual function pointer for valent_contact_store_get_contact()
  * @remove_contact: the virtual function pointer for valent_contact_store_remove_contact()
  * @query: the virtual function pointer for valent_contact_store_query()
+ * @query_fields: the virtual function pointer for valent_contact_store_query_fields()
  * @contact_added: the class closure for #ValentContactStore::contact-added
  * @contact_removed: the class closure for #ValentContactStore::contact-removed
  *
@@ -61,6 +62,13 @@ enum {
 static guint signals[N_SIGNALS] = { 0, };
 
 
+static inline void
+object_slist_free (gpointer slist)
+{
+  g_slist_free_full (slist, g_object_unref);
+}
+
+
 /*
  * Signal Emission Helpers
  */
@@ -196,6 +204,73 @@ valent_contact_store_real_query (ValentContactStore  *store,
 }
 /* LCOV_EXCL_STOP */
 
+static void
+valent_contact_store_real_query_fields_cb (ValentContactStore *store,
+                                           GAsyncResult       *result,
+                                           gpointer            user_data)
+{
+  g_autoptr (GTask) task = G_TASK (user_data);
+  const char * const *fields = g_task_get_task_data (task);
+  GSList *contacts = NULL;
+  GSList *projected = NULL;
+  GError *error = NULL;
+
+  contacts = valent_contact_store_query_finish (store, result, &error);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  for (const GSList *iter = contacts; iter; iter = iter->next)
+    {
+      EContact *contact = e_contact_new ();
+      GList *attrs = e_vcard_get_attributes (E_VCARD (iter->data));
+
+      for (const GList *aiter = attrs; aiter; aiter = aiter->next)
+        {
+          const char *name = e_vcard_attribute_get_name (aiter->data);
+
+          if (g_strv_contains (fields, name) || g_ascii_strcasecmp (name, EVC_UID) == 0)
+            e_vcard_append_attribute (E_VCARD (contact),
+                                      e_vcard_attribute_copy (aiter->data));
+        }
+
+      projected = g_slist_prepend (projected, contact);
+    }
+  g_slist_free_full (contacts, g_object_unref);
+
+  g_task_return_pointer (task,
+                         g_slist_reverse (projected),
+                         (GDestroyNotify)object_slist_free);
+}
+
+static void
+valent_contact_store_real_query_fields (ValentContactStore  *store,
+                                        const char          *query,
+                                        const char * const  *fields,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_assert (VALENT_IS_CONTACT_STORE (store));
+  g_assert (query != NULL);
+  g_assert (fields != NULL);
+  g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (store, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_contact_store_real_query_fields);
+  g_task_set_task_data (task,
+                        g_strdupv ((char **)fields),
+                        (GDestroyNotify)g_strfreev);
+
+  VALENT_CONTACT_STORE_GET_CLASS (store)->query (store,
+                                                 query,
+                                                 cancellable,
+                                                 (GAsyncReadyCallback)valent_contact_store_real_query_fields_cb,
+                                                 g_steal_pointer (&task));
+}
+
 /*
  * GObject
  */
@@ -275,6 +350,7 @@ valent_contact_store_class_init (ValentContactStoreClass *klass)
   klass->remove_contacts = valent_contact_store_real_remove_contacts;
   klass->query = valent_contact_store_real_query;
   klass->get_contact = valent_contact_store_real_get_contact;
+  klass->query_fields = valent_contact_store_real_query_fields;
 
   /**
    * ValentContactStore:name: (getter get_name) (setter set_name)
@@ -781,13 +857,58 @@ valent_contact_store_query (ValentContactStore  *store,
   VALENT_EXIT;
 }
 
+/**
+ * valent_contact_store_query_fields: (virtual query_fields)
+ * @store: a #ValentContactStore
+ * @query: a search expression
+ * @fields: (array zero-terminated=1): a list of vCard attribute names
+ * @cancellable: (nullable): #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Query @store for contacts matching @query, holding only the attributes in
+ * @fields (e.g. `EVC_FN`, `EVC_TEL`) and the UID.
+ *
+ * This is cheaper than [method@Valent.ContactStore.query] when the caller
+ * doesn't need the full vCard, such as a photo.
+ *
+ * Call [method@Valent.ContactStore.query_finish] to get the result.
+ *
+ * Since: 1.0
+ */
+void
+valent_contact_store_query_fields (ValentContactStore  *store,
+                                   const char          *query,
+                                   const char * const  *fields,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_CONTACT_STORE (store));
+  g_return_if_fail (query != NULL);
+  g_return_if_fail (fields != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  VALENT_CONTACT_STORE_GET_CLASS (store)->query_fields (store,
+                                                        query,
+                                                        fields,
+                                                        cancellable,
+                                                        callback,
+                                                        user_data);
+
+  VALENT_EXIT;
+}
+
 /**
  * valent_contact_store_query_finish:
  * @store: a #ValentContactStore
  * @result: a #GAsyncResult
  * @error: (nullable): a #GError
  *
- * Finish an operation started by [method@Valent.ContactStore.query].
+ * Finish an operation started by [method@Valent.ContactStore.query] or
+ * [method@Valent.ContactStore.query_fields].
  *
  * Returns: (transfer full) (element-type EContact): a #GSList
  *
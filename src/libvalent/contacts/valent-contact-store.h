@@ -42,6 +42,12 @@ struct _ValentContactStoreClass
                                           GCancellable         *cancellable,
                                           GAsyncReadyCallback   callback,
                                           gpointer              user_data);
+  void                (*query_fields)    (ValentContactStore   *store,
+                                          const char           *query,
+                                          const char * const   *fields,
+                                          GCancellable         *cancellable,
+                                          GAsyncReadyCallback   callback,
+                                          gpointer              user_data);
 
   /* signals */
   void                (*contact_added)   (ValentContactStore   *store,
@@ -50,7 +56,7 @@ struct _ValentContactStoreClass
                                           const char           *uid);
 
   /*< private >*/
-  gpointer            padding[8];
+  gpointer            padding[7];
 };
 
 
@@ -125,6 +131,13 @@ void         valent_contact_store_query                  (ValentContactStore   *
                                                           GAsyncReadyCallback   callback,
                                                           gpointer              user_data);
 VALENT_AVAILABLE_IN_1_0
+void         valent_contact_store_query_fields           (ValentContactStore   *store,
+                                                          const char           *query,
+                                                          const char * const   *fields,
+                                                          GCancellable         *cancellable,
+                                                          GAsyncReadyCallback   callback,
+                                                          gpointer              user_data);
+VALENT_AVAILABLE_IN_1_0
 GSList     * valent_contact_store_query_finish           (ValentContactStore   *store,
                                                           GAsyncResult         *result,
                                                           GError              **error);
@@ -24,6 +24,9 @@
 
 /* LCOV_EXCL_START */
 
+/* If zero, trace messages are not formatted and only timings are recorded */
+static int trace_log_enabled = TRUE;
+
 #ifdef HAVE_SYSPROF
 G_LOCK_DEFINE_STATIC (sysprof_mutex);
 
@@ -38,6 +41,103 @@ current_cpu (void)
   return 0;
 #endif /* HAVE_SCHED_GETCPU */
 }
+
+/*
+ * Function marks are recorded in a per-thread buffer, then written to the
+ * capture in a batch when the buffer fills, when a second has passed since the
+ * last flush, when the thread exits or when valent_debug_clear() is called.
+ *
+ * Each buffer has its own lock, which is only contended while the buffers are
+ * being cleared. A thread that stops tracing holds its marks until its next
+ * mark, or until the buffers are cleared.
+ *
+ * Locks are always taken in the order: registry, buffer, sysprof.
+ */
+#define TRACE_BUFFER_SIZE    (512)
+#define TRACE_FLUSH_INTERVAL (G_USEC_PER_SEC)
+
+typedef struct
+{
+  const char *strfunc;
+  int64_t     begin_time_usec;
+  int64_t     end_time_usec;
+  int         cpu;
+} TraceMark;
+
+typedef struct
+{
+  GMutex       mutex;
+  int64_t      flush_time_usec;
+  unsigned int n_marks;
+  TraceMark    marks[TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+G_LOCK_DEFINE_STATIC (trace_buffers_mutex);
+static GPtrArray *trace_buffers = NULL;
+
+/* Called with the buffer lock held */
+static void
+trace_buffer_flush (TraceBuffer *buffer)
+{
+  G_LOCK (sysprof_mutex);
+  if G_LIKELY (sysprof)
+    {
+      for (unsigned int i = 0; i < buffer->n_marks; i++)
+        {
+          const TraceMark *mark = &buffer->marks[i];
+
+          sysprof_capture_writer_add_mark (sysprof,
+                                           mark->begin_time_usec * 1000L,
+                                           mark->cpu,
+                                           getpid (),
+                                           (mark->end_time_usec - mark->begin_time_usec) * 1000L,
+                                           "tracing",
+                                           "function",
+                                           mark->strfunc);
+        }
+    }
+  G_UNLOCK (sysprof_mutex);
+
+  buffer->n_marks = 0;
+  buffer->flush_time_usec = g_get_monotonic_time ();
+}
+
+static TraceBuffer *
+trace_buffer_new (int64_t flush_time_usec)
+{
+  TraceBuffer *buffer;
+
+  buffer = g_new0 (TraceBuffer, 1);
+  g_mutex_init (&buffer->mutex);
+  buffer->flush_time_usec = flush_time_usec;
+
+  G_LOCK (trace_buffers_mutex);
+  if (trace_buffers == NULL)
+    trace_buffers = g_ptr_array_new ();
+  g_ptr_array_add (trace_buffers, buffer);
+  G_UNLOCK (trace_buffers_mutex);
+
+  return buffer;
+}
+
+static void
+trace_buffer_free (gpointer data)
+{
+  TraceBuffer *buffer = data;
+
+  G_LOCK (trace_buffers_mutex);
+  g_ptr_array_remove_fast (trace_buffers, buffer);
+  G_UNLOCK (trace_buffers_mutex);
+
+  g_mutex_lock (&buffer->mutex);
+  trace_buffer_flush (buffer);
+  g_mutex_unlock (&buffer->mutex);
+
+  g_mutex_clear (&buffer->mutex);
+  g_free (buffer);
+}
+
+static GPrivate trace_buffer_key = G_PRIVATE_INIT (trace_buffer_free);
 #endif /* HAVE_SYSPROF */
 
 static void
@@ -67,26 +167,42 @@ valent_trace_mark (const char *strfunc,
                    int64_t     end_time_usec)
 {
 #ifdef HAVE_SYSPROF
-  G_LOCK (sysprof_mutex);
-  if G_LIKELY (sysprof)
+  TraceBuffer *buffer;
+  TraceMark *mark;
+
+  if (g_atomic_pointer_get (&sysprof) == NULL)
+    return;
+
+  if G_UNLIKELY ((buffer = g_private_get (&trace_buffer_key)) == NULL)
     {
-      /* In case our clock is not reliable */
-      if (end_time_usec < begin_time_usec)
-        end_time_usec = begin_time_usec;
-
-      sysprof_capture_writer_add_mark (sysprof,
-                                       begin_time_usec * 1000L,
-                                       current_cpu (),
-                                       getpid (),
-                                       (end_time_usec - begin_time_usec) * 1000L,
-                                       "tracing",
-                                       "function",
-                                       strfunc);
+      buffer = trace_buffer_new (end_time_usec);
+      g_private_set (&trace_buffer_key, buffer);
     }
-  G_UNLOCK (sysprof_mutex);
+
+  /* In case our clock is not reliable */
+  if (end_time_usec < begin_time_usec)
+    end_time_usec = begin_time_usec;
+
+  g_mutex_lock (&buffer->mutex);
+  mark = &buffer->marks[buffer->n_marks++];
+  mark->strfunc = strfunc;
+  mark->begin_time_usec = begin_time_usec;
+  mark->end_time_usec = end_time_usec;
+  mark->cpu = current_cpu ();
+
+  if (buffer->n_marks == TRACE_BUFFER_SIZE ||
+      end_time_usec - buffer->flush_time_usec >= TRACE_FLUSH_INTERVAL)
+    trace_buffer_flush (buffer);
+  g_mutex_unlock (&buffer->mutex);
 #endif /* HAVE_SYSPROF */
 }
 
+gboolean
+valent_trace_log_enabled (void)
+{
+  return g_atomic_int_get (&trace_log_enabled);
+}
+
 
 G_LOCK_DEFINE_STATIC (log_mutex);
 
@@ -192,13 +308,17 @@ valent_log_handler (const char     *log_domain,
  * This should be called before the application starts, which is typically when
  * [method@Gio.Application.run] is invoked.
  *
- * If %VALENT_DEBUG_ENABLE is defined, debugging messages only useful for
+ * If %VALENT_ENABLE_DEBUG is defined, debugging messages only useful for
  * development will be printed to the log.
  *
- * If %VALENT_TRACE_ENABLE is defined, tracing will be performed at the log
+ * If %VALENT_ENABLE_TRACE is defined, tracing will be performed at the log
  * level %VALENT_LOG_LEVEL_TRACE. These will be passed to sysprof for profiling,
  * if available.
  *
+ * If the `VALENT_TRACE` environment variable is set to `marks`, trace messages
+ * will not be formatted or logged and only function timings will be recorded.
+ * This keeps the overhead low enough to leave tracing enabled.
+ *
  * Since: 1.0
  */
 void
@@ -217,16 +337,19 @@ valent_debug_init (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+  if (g_strcmp0 (g_getenv ("VALENT_TRACE"), "marks") == 0)
+    g_atomic_int_set (&trace_log_enabled, FALSE);
+
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
   G_LOCK (sysprof_mutex);
   if (sysprof == NULL)
     {
       signal (SIGPIPE, SIG_IGN);
       sysprof_clock_init ();
-      sysprof = sysprof_capture_writer_new_from_env (0);
+      g_atomic_pointer_set (&sysprof, sysprof_capture_writer_new_from_env (0));
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
 }
 
 /**
@@ -250,15 +373,29 @@ valent_debug_clear (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
+  /* Flush the marks buffered by every thread */
+  G_LOCK (trace_buffers_mutex);
+  for (unsigned int i = 0; trace_buffers != NULL && i < trace_buffers->len; i++)
+    {
+      TraceBuffer *buffer = g_ptr_array_index (trace_buffers, i);
+
+      g_mutex_lock (&buffer->mutex);
+      trace_buffer_flush (buffer);
+      g_mutex_unlock (&buffer->mutex);
+    }
+  G_UNLOCK (trace_buffers_mutex);
+
   G_LOCK (sysprof_mutex);
   if (sysprof != NULL)
     {
-      sysprof_capture_writer_flush (sysprof);
-      g_clear_pointer (&sysprof, sysprof_capture_writer_unref);
+      SysprofCaptureWriter *writer = g_atomic_pointer_exchange (&sysprof, NULL);
+
+      sysprof_capture_writer_flush (writer);
+      sysprof_capture_writer_unref (writer);
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
 }
 
 /* LCOV_EXCL_STOP */
@@ -31,6 +31,10 @@ typedef struct
   GCancellable *cancellable;
   unsigned int  in_destruction : 1;
   unsigned int  destroyed : 1;
+
+  /* Notifications queued from other threads, guarded by bit 0 of notify_lock */
+  GPtrArray    *notify_pending;
+  int           notify_lock;
 } ValentObjectPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (ValentObject, valent_object, G_TYPE_OBJECT)
@@ -90,42 +94,71 @@ valent_object_dispose_main (ValentObject *object)
 
 /*
  * GObject.Object::notify
+ *
+ * Notifications from other threads are collected in a per-object set, so that
+ * repeated notifications of the same property before the main loop runs result
+ * in a single emission. Only the first pending notification schedules an idle
+ * callback, which holds a weak reference to the object.
  */
-typedef struct
-{
-  GRecMutex   mutex;
-  GWeakRef    object;
-  GParamSpec *pspec;
-  char       *property_name;
-} NotifyEmission;
-
 static gboolean
 valent_object_notify_main (gpointer data)
 {
-  NotifyEmission *emission = data;
+  GWeakRef *ref = data;
   g_autoptr (GObject) object = NULL;
+  g_autoptr (GPtrArray) pending = NULL;
 
-  g_assert (emission != NULL);
+  g_assert (ref != NULL);
 
-  g_rec_mutex_lock (&emission->mutex);
-  if ((object = g_weak_ref_get (&emission->object)) != NULL)
+  if ((object = g_weak_ref_get (ref)) != NULL)
     {
-      if (emission->pspec != NULL)
-        g_object_notify_by_pspec (object, emission->pspec);
-      else
-        g_object_notify (object, emission->property_name);
+      ValentObjectPrivate *priv = valent_object_get_instance_private (VALENT_OBJECT (object));
+
+      g_bit_lock (&priv->notify_lock, 0);
+      pending = g_steal_pointer (&priv->notify_pending);
+      g_bit_unlock (&priv->notify_lock, 0);
+
+      g_object_freeze_notify (object);
+      for (unsigned int i = 0; pending != NULL && i < pending->len; i++)
+        g_object_notify_by_pspec (object, g_ptr_array_index (pending, i));
+      g_object_thaw_notify (object);
     }
 
-  g_weak_ref_clear (&emission->object);
-  g_clear_pointer (&emission->property_name, g_free);
-  g_clear_pointer (&emission->pspec, g_param_spec_unref);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
+  g_weak_ref_clear (ref);
+  g_free (ref);
 
   return G_SOURCE_REMOVE;
 }
 
+static void
+valent_object_notify_queue (ValentObject *object,
+                            GParamSpec   *pspec)
+{
+  ValentObjectPrivate *priv = valent_object_get_instance_private (object);
+  gboolean schedule = FALSE;
+
+  g_bit_lock (&priv->notify_lock, 0);
+  if (priv->notify_pending == NULL)
+    {
+      priv->notify_pending = g_ptr_array_new_with_free_func ((GDestroyNotify)g_param_spec_unref);
+      schedule = TRUE;
+    }
+
+  if (!g_ptr_array_find (priv->notify_pending, pspec, NULL))
+    g_ptr_array_add (priv->notify_pending, g_param_spec_ref (pspec));
+  g_bit_unlock (&priv->notify_lock, 0);
+
+  if (schedule)
+    {
+      GWeakRef *ref = g_new0 (GWeakRef, 1);
+
+      g_weak_ref_init (ref, object);
+      g_idle_add_full (G_PRIORITY_DEFAULT,
+                       valent_object_notify_main,
+                       ref,
+                       NULL);
+    }
+}
+
 /*
  * ValentObject
  */
@@ -190,6 +223,7 @@ valent_object_finalize (GObject *object)
     }
 
   g_clear_object (&priv->cancellable);
+  g_clear_pointer (&priv->notify_pending, g_ptr_array_unref);
   g_rec_mutex_clear (&priv->mutex);
 
   G_OBJECT_CLASS (valent_object_parent_class)->finalize (object);
@@ -568,7 +602,8 @@ valent_object_in_destruction (ValentObject *object)
  * Emit [signal@GObject.Object::notify] on @object, on the main thread.
  *
  * Like [method@GObject.Object.notify] if the caller is in the main thread,
- * otherwise the invocation is deferred to the main thread.
+ * otherwise the invocation is deferred to the main thread. Repeated deferred
+ * notifications for the same property are emitted once.
  *
  * Since: 1.0
  */
@@ -576,7 +611,7 @@ void
 valent_object_notify (ValentObject *object,
                       const char   *property_name)
 {
-  NotifyEmission *emission = NULL;
+  GParamSpec *pspec;
 
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (property_name != NULL);
@@ -587,17 +622,19 @@ valent_object_notify (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->property_name = g_strdup (property_name);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                        property_name);
+
+  if G_UNLIKELY (pspec == NULL)
+    {
+      g_critical ("%s: object class '%s' has no property named '%s'",
+                  G_STRFUNC,
+                  G_OBJECT_TYPE_NAME (object),
+                  property_name);
+      return;
+    }
+
+  valent_object_notify_queue (object, pspec);
 }
 
 /**
@@ -608,7 +645,8 @@ valent_object_notify (ValentObject *object,
  * Emit [signal@GObject.Object::notify] on @object, on the main thread.
  *
  * Like [method@GObject.Object.notify_by_pspec] if the caller is in the main
- * thread, otherwise the invocation is deferred to the main thread.
+ * thread, otherwise the invocation is deferred to the main thread. Repeated
+ * deferred notifications for the same property are emitted once.
  *
  * Since: 1.0
  */
@@ -616,8 +654,6 @@ void
 valent_object_notify_by_pspec (ValentObject *object,
                                GParamSpec   *pspec)
 {
-  NotifyEmission *emission = NULL;
-
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (G_IS_PARAM_SPEC (pspec));
 
@@ -627,15 +663,5 @@ valent_object_notify_by_pspec (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->pspec = g_param_spec_ref (pspec);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  valent_object_notify_queue (object, pspec);
 }
@@ -28,7 +28,8 @@
  * The core of the KDE Connect protocol is built on the exchange of JSON
  * packets, similar to JSON-RPC. Packets can be queued concurrently from
  * different threads with [method@Valent.Channel.write_packet] and read
- * sequentially with [method@Valent.Channel.read_packet].
+ * sequentially with [method@Valent.Channel.read_packet], or in batches with
+ * [method@Valent.Channel.read_packets].
  *
  * Packets may contain payload information, allowing devices to negotiate
  * auxiliary connections. Incoming connections can be accepted by passing the
@@ -48,17 +49,29 @@
 
 typedef struct
 {
-  GIOStream        *base_stream;
-  JsonNode         *identity;
-  JsonNode         *peer_identity;
+  GIOStream            *base_stream;
+  JsonNode             *identity;
+  JsonNode             *peer_identity;
 
   /* Packet Buffer */
-  GDataInputStream *input_buffer;
-  GMainLoop        *output_buffer;
+  GBufferedInputStream *input_buffer;
+  struct _PacketReader *input_reader;
+  GMainLoop            *output_buffer;
+  GQueue                output_queue;
+  GString              *output_data;
+
+  /* Output Statistics */
+  uint64_t              n_flushes;
+  uint64_t              n_flushed_packets;
+  uint64_t              n_flushed_bytes;
 } ValentChannelPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (ValentChannel, valent_channel, VALENT_TYPE_OBJECT)
 
+#define VALENT_CHANNEL_BUFFER_SIZE (64 * 1024)
+#define VALENT_CHANNEL_QUEUE_MAX    (256)
+#define VALENT_CHANNEL_OUTPUT_MAX   (1024 * 1024)
+
 /**
  * ValentChannelClass:
  * @get_verification_key: the virtual function pointer for valent_channel_get_verification_key()
@@ -241,6 +254,176 @@ valent_channel_real_store_data (ValentChannel *channel,
 /* LCOV_EXCL_STOP */
 
 
+/*
+ * PacketReader:
+ *
+ * Each channel owns a single thread that reads packets continuously from the
+ * input buffer, queueing them until they are collected on the main context.
+ * The state is shared with the thread, so the channel can be finalized while
+ * a read is blocking; the thread exits when the reader is closed.
+ */
+typedef struct _PacketReader
+{
+  GMutex                mutex;
+  GCond                 cond;
+  GBufferedInputStream *stream;
+  GCancellable         *cancellable;
+
+  /* Input Queue */
+  GQueue                packets;
+  GError               *error;
+  GTask                *task;
+} PacketReader;
+
+static PacketReader *
+packet_reader_new (GBufferedInputStream *stream)
+{
+  PacketReader *reader;
+
+  reader = g_atomic_rc_box_new0 (PacketReader);
+  g_mutex_init (&reader->mutex);
+  g_cond_init (&reader->cond);
+  g_queue_init (&reader->packets);
+
+  reader->stream = g_object_ref (stream);
+  reader->cancellable = g_cancellable_new ();
+
+  return reader;
+}
+
+static void
+packet_reader_close (PacketReader *reader)
+{
+  g_cancellable_cancel (reader->cancellable);
+
+  g_mutex_lock (&reader->mutex);
+  g_cond_broadcast (&reader->cond);
+  g_mutex_unlock (&reader->mutex);
+}
+
+static void
+packet_reader_free (gpointer data)
+{
+  PacketReader *reader = data;
+
+  g_assert (reader->task == NULL);
+
+  g_queue_clear_full (&reader->packets, (GDestroyNotify)json_node_unref);
+  g_clear_error (&reader->error);
+  g_clear_object (&reader->cancellable);
+  g_clear_object (&reader->stream);
+
+  g_cond_clear (&reader->cond);
+  g_mutex_clear (&reader->mutex);
+}
+
+static void
+packet_reader_unref (gpointer data)
+{
+  g_atomic_rc_box_release_full (data, packet_reader_free);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PacketReader, packet_reader_unref)
+
+/*
+ * Complete @task with the packets in @reader, or the terminal error if the
+ * queue is empty. If there is nothing to return, @task becomes the pending
+ * request, unless another request is already pending.
+ */
+static void
+packet_reader_return (PacketReader *reader,
+                      GTask        *task)
+{
+  g_autoptr (GPtrArray) packets = NULL;
+  JsonNode *packet = NULL;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  g_mutex_lock (&reader->mutex);
+  if (g_task_get_source_tag (task) == valent_channel_read_packet)
+    {
+      packet = g_queue_pop_head (&reader->packets);
+    }
+  else if (!g_queue_is_empty (&reader->packets))
+    {
+      packets = g_ptr_array_new_full (reader->packets.length,
+                                      (GDestroyNotify)json_node_unref);
+
+      while (!g_queue_is_empty (&reader->packets))
+        g_ptr_array_add (packets, g_queue_pop_head (&reader->packets));
+    }
+
+  if (packet == NULL && packets == NULL)
+    {
+      if (reader->error != NULL)
+        {
+          error = g_error_copy (reader->error);
+        }
+      else if (reader->task != NULL)
+        {
+          g_mutex_unlock (&reader->mutex);
+          g_task_return_new_error (task,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_PENDING,
+                                   "A read operation is already pending");
+          return;
+        }
+      else
+        {
+          reader->task = g_object_ref (task);
+          g_mutex_unlock (&reader->mutex);
+          return;
+        }
+    }
+
+  g_cond_signal (&reader->cond);
+  g_mutex_unlock (&reader->mutex);
+
+  if (packet != NULL)
+    g_task_return_pointer (task, packet, (GDestroyNotify)json_node_unref);
+  else if (packets != NULL)
+    g_task_return_pointer (task, g_steal_pointer (&packets),
+                           (GDestroyNotify)g_ptr_array_unref);
+  else
+    g_task_return_error (task, error);
+}
+
+static JsonNode *
+packet_reader_read (PacketReader  *reader,
+                    GError       **error)
+{
+  gssize read;
+
+  /* Distinguish the end of the stream from a malformed packet */
+  if (g_buffered_input_stream_get_available (reader->stream) == 0)
+    {
+      read = g_buffered_input_stream_fill (reader->stream,
+                                           -1,
+                                           reader->cancellable,
+                                           error);
+
+      if (read < 0)
+        return NULL;
+
+      if (read == 0)
+        {
+          g_set_error_literal (error,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CONNECTION_CLOSED,
+                               "Channel is closed");
+          return NULL;
+        }
+    }
+
+  return valent_packet_from_stream (G_INPUT_STREAM (reader->stream),
+                                    -1,
+                                    reader->cancellable,
+                                    error);
+}
+
+
 /*
  * ValentChannel
  */
@@ -258,6 +441,8 @@ valent_channel_return_error_if_closed (ValentChannel *self,
     {
       if (priv->output_buffer != NULL)
         g_main_loop_quit (priv->output_buffer);
+      if (priv->input_reader != NULL)
+        packet_reader_close (priv->input_reader);
       g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
       g_clear_object (&priv->input_buffer);
       valent_object_unlock (VALENT_OBJECT (self));
@@ -272,6 +457,90 @@ valent_channel_return_error_if_closed (ValentChannel *self,
   return FALSE;
 }
 
+static gpointer
+valent_channel_read_packet_worker (gpointer data)
+{
+  g_autoptr (PacketReader) reader = (PacketReader *)data;
+
+  while (TRUE)
+    {
+      g_autoptr (GTask) task = NULL;
+      JsonNode *packet = NULL;
+      GError *error = NULL;
+
+      /* Wait for the queue to drain if the packets aren't being collected */
+      g_mutex_lock (&reader->mutex);
+      while (reader->packets.length >= VALENT_CHANNEL_QUEUE_MAX &&
+             !g_cancellable_is_cancelled (reader->cancellable))
+        g_cond_wait (&reader->cond, &reader->mutex);
+      g_mutex_unlock (&reader->mutex);
+
+      if (!g_cancellable_is_cancelled (reader->cancellable))
+        packet = packet_reader_read (reader, &error);
+
+      /* Report a closed channel, rather than the cancellation */
+      if (packet == NULL && g_cancellable_is_cancelled (reader->cancellable))
+        {
+          g_clear_error (&error);
+          g_set_error_literal (&error,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CONNECTION_CLOSED,
+                               "Channel is closed");
+        }
+
+      g_mutex_lock (&reader->mutex);
+      if (packet != NULL)
+        g_queue_push_tail (&reader->packets, packet);
+      else
+        reader->error = error;
+      task = g_steal_pointer (&reader->task);
+      g_mutex_unlock (&reader->mutex);
+
+      if (task != NULL)
+        packet_reader_return (reader, task);
+
+      if (packet == NULL)
+        break;
+    }
+
+  return NULL;
+}
+
+static void
+valent_channel_read_start (ValentChannel *self,
+                           GTask         *task)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+  g_autoptr (PacketReader) reader = NULL;
+
+  valent_object_lock (VALENT_OBJECT (self));
+  if (priv->input_reader == NULL)
+    {
+      GThread *thread;
+
+      if (priv->input_buffer == NULL || g_io_stream_is_closed (priv->base_stream))
+        {
+          valent_object_unlock (VALENT_OBJECT (self));
+          g_task_return_new_error (task,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_CONNECTION_CLOSED,
+                                   "Channel is closed");
+          return;
+        }
+
+      priv->input_reader = packet_reader_new (priv->input_buffer);
+      thread = g_thread_new ("valent-channel-input",
+                             valent_channel_read_packet_worker,
+                             g_atomic_rc_box_acquire (priv->input_reader));
+      g_clear_pointer (&thread, g_thread_unref);
+    }
+
+  reader = g_atomic_rc_box_acquire (priv->input_reader);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  packet_reader_return (reader, task);
+}
+
 static gpointer
 valent_channel_write_packet_worker (gpointer data)
 {
@@ -310,8 +579,9 @@ valent_channel_set_base_stream (ValentChannel *self,
       input_stream = g_io_stream_get_input_stream (base_stream);
 
       priv->base_stream = g_object_ref (base_stream);
-      priv->input_buffer = g_object_new (G_TYPE_DATA_INPUT_STREAM,
+      priv->input_buffer = g_object_new (G_TYPE_BUFFERED_INPUT_STREAM,
                                          "base-stream",       input_stream,
+                                         "buffer-size",       VALENT_CHANNEL_BUFFER_SIZE,
                                          "close-base-stream", FALSE,
                                          NULL);
 
@@ -336,6 +606,11 @@ valent_channel_finalize (GObject *object)
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
 
   valent_object_lock (VALENT_OBJECT (self));
+  if (priv->input_reader != NULL)
+    packet_reader_close (priv->input_reader);
+  g_clear_pointer (&priv->input_reader, packet_reader_unref);
+  g_queue_clear_full (&priv->output_queue, g_object_unref);
+  g_string_free (priv->output_data, TRUE);
   g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
   g_clear_object (&priv->input_buffer);
   g_clear_object (&priv->base_stream);
@@ -485,6 +760,10 @@ valent_channel_class_init (ValentChannelClass *klass)
 static void
 valent_channel_init (ValentChannel *self)
 {
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+
+  g_queue_init (&priv->output_queue);
+  priv->output_data = g_string_sized_new (VALENT_CHANNEL_BUFFER_SIZE);
 }
 
 /**
@@ -611,6 +890,8 @@ valent_channel_close (ValentChannel  *channel,
 
       if (priv->output_buffer != NULL)
         g_main_loop_quit (priv->output_buffer);
+      if (priv->input_reader != NULL)
+        packet_reader_close (priv->input_reader);
       g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
       g_clear_object (&priv->input_buffer);
     }
@@ -700,42 +981,6 @@ valent_channel_close_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
-static void
-valent_channel_read_packet_task (GTask        *task,
-                                 gpointer      source_object,
-                                 gpointer      task_data,
-                                 GCancellable *cancellable)
-{
-  ValentChannel *self = VALENT_CHANNEL (source_object);
-  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
-  g_autoptr (GDataInputStream) stream = NULL;
-  g_autofree char *line = NULL;
-  JsonNode *packet = NULL;
-  GError *error = NULL;
-
-  if (valent_channel_return_error_if_closed (self, task))
-      return;
-
-  stream = g_object_ref (priv->input_buffer);
-  valent_object_unlock (VALENT_OBJECT (self));
-
-  line = g_data_input_stream_read_line_utf8 (stream, NULL, cancellable, &error);
-
-  if (error != NULL)
-    return g_task_return_error (task, error);
-
-  if (line == NULL)
-    return g_task_return_new_error (task,
-                                    G_IO_ERROR,
-                                    G_IO_ERROR_CONNECTION_CLOSED,
-                                    "Channel is closed");
-
-  if ((packet = valent_packet_deserialize (line, &error)) == NULL)
-    return g_task_return_error (task, error);
-
-  g_task_return_pointer (task, packet, (GDestroyNotify)json_node_unref);
-}
-
 /**
  * valent_channel_read_packet:
  * @channel: a #ValentChannel
@@ -764,7 +1009,7 @@ valent_channel_read_packet (ValentChannel       *channel,
 
   task = g_task_new (channel, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_channel_read_packet);
-  g_task_run_in_thread (task, valent_channel_read_packet_task);
+  valent_channel_read_start (channel, task);
 
   VALENT_EXIT;
 }
@@ -799,33 +1044,199 @@ valent_channel_read_packet_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+/**
+ * valent_channel_read_packets:
+ * @channel: a #ValentChannel
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Read all the KDE Connect packets currently available from @channel.
+ *
+ * Packets are read continuously by a thread owned by the channel, and queued
+ * until collected. This operation completes with every queued packet, or waits
+ * for the next packet if the queue is empty.
+ *
+ * Call [method@Valent.Channel.read_packets_finish] to get the result.
+ *
+ * Since: 1.0
+ */
+void
+valent_channel_read_packets (ValentChannel       *channel,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_CHANNEL (channel));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (channel, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_channel_read_packets);
+  valent_channel_read_start (channel, task);
+
+  VALENT_EXIT;
+}
+
+/**
+ * valent_channel_read_packets_finish:
+ * @channel: a #ValentChannel
+ * @result: a #GAsyncResult
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by [method@Valent.Channel.read_packets].
+ *
+ * Returns: (transfer container) (element-type Json.Node): a list of KDE
+ *   Connect packets, or %NULL with @error set
+ *
+ * Since: 1.0
+ */
+GPtrArray *
+valent_channel_read_packets_finish (ValentChannel  *channel,
+                                    GAsyncResult   *result,
+                                    GError        **error)
+{
+  GPtrArray *ret;
+
+  VALENT_ENTRY;
+
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, channel), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = g_task_propagate_pointer (G_TASK (result), error);
+
+  VALENT_RETURN (ret);
+}
+
+static void
+on_write_cancelled (GCancellable *task_cancellable,
+                    GCancellable *cancellable)
+{
+  g_cancellable_cancel (cancellable);
+}
+
+/*
+ * Drain the output queue, serializing every pending packet into the output
+ * buffer and writing them together. Each task is still completed individually.
+ */
 static gboolean
-valent_channel_write_packet_func (gpointer data)
+valent_channel_write_packets_func (gpointer data)
 {
-  GTask *task = G_TASK (data);
-  ValentChannel *self = g_task_get_source_object (task);
+  ValentChannel *self = VALENT_CHANNEL (data);
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
   g_autoptr (GOutputStream) stream = NULL;
-  JsonNode *packet = NULL;
-  GCancellable *cancellable = NULL;
+  g_autoptr (GPtrArray) tasks = NULL;
+  GString *buffer = priv->output_data;
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autoptr (GCancellable) destroy = NULL;
+  g_autofree unsigned long *handler_ids = NULL;
+  size_t n_written = 0;
   GError *error = NULL;
 
-  g_assert (G_IS_TASK (task));
   g_assert (VALENT_IS_CHANNEL (self));
 
-  if (valent_channel_return_error_if_closed (self, task))
-    return G_SOURCE_REMOVE;
+  valent_object_lock (VALENT_OBJECT (self));
+  tasks = g_ptr_array_new_full (priv->output_queue.length, g_object_unref);
+
+  while (!g_queue_is_empty (&priv->output_queue))
+    g_ptr_array_add (tasks, g_queue_pop_head (&priv->output_queue));
 
-  stream = g_object_ref (g_io_stream_get_output_stream (priv->base_stream));
+  if (priv->base_stream != NULL && !g_io_stream_is_closed (priv->base_stream))
+    stream = g_object_ref (g_io_stream_get_output_stream (priv->base_stream));
   valent_object_unlock (VALENT_OBJECT (self));
 
-  packet = g_task_get_task_data (task);
-  cancellable = g_task_get_cancellable (task);
+  /* Serialize the packets, dropping any tasks that are no longer pending */
+  g_string_truncate (buffer, 0);
 
-  if (valent_packet_to_stream (stream, packet, cancellable, &error))
-    g_task_return_boolean (task, TRUE);
-  else
-    g_task_return_error (task, error);
+  for (unsigned int i = 0; i < tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (tasks, i);
+      JsonNode *packet = g_task_get_task_data (task);
+
+      if (valent_channel_return_error_if_closed (self, task))
+        {
+          g_ptr_array_remove_index (tasks, i--);
+          continue;
+        }
+      valent_object_unlock (VALENT_OBJECT (self));
+
+      if (!valent_packet_validate (packet, &error))
+        {
+          g_task_return_error (task, g_steal_pointer (&error));
+          g_ptr_array_remove_index (tasks, i--);
+          continue;
+        }
+
+      valent_packet_to_gstring (packet, buffer);
+    }
+
+  if (tasks->len == 0)
+    return G_SOURCE_REMOVE;
+
+  /* The write is interrupted if the channel is destroyed or any of the tasks
+   * is cancelled, since a stalled peer would otherwise block the queue */
+  cancellable = g_cancellable_new ();
+  destroy = valent_object_chain_cancellable (VALENT_OBJECT (self), cancellable);
+  handler_ids = g_new0 (unsigned long, tasks->len);
+
+  for (unsigned int i = 0; i < tasks->len; i++)
+    {
+      GCancellable *task_cancellable;
+
+      task_cancellable = g_task_get_cancellable (g_ptr_array_index (tasks, i));
+
+      if (task_cancellable != NULL)
+        handler_ids[i] = g_cancellable_connect (task_cancellable,
+                                                G_CALLBACK (on_write_cancelled),
+                                                cancellable,
+                                                NULL);
+    }
+
+  g_output_stream_write_all (stream,
+                             buffer->str,
+                             buffer->len,
+                             &n_written,
+                             cancellable,
+                             &error);
+
+  for (unsigned int i = 0; i < tasks->len; i++)
+    {
+      if (handler_ids[i] != 0)
+        g_cancellable_disconnect (g_task_get_cancellable (g_ptr_array_index (tasks, i)),
+                                  handler_ids[i]);
+    }
+
+  priv->n_flushes += 1;
+  priv->n_flushed_packets += tasks->len;
+  priv->n_flushed_bytes += n_written;
+  VALENT_NOTE ("flushed %u packets (%zu bytes); average %.1f packets (%.1f bytes)",
+               tasks->len,
+               n_written,
+               (double)priv->n_flushed_packets / priv->n_flushes,
+               (double)priv->n_flushed_bytes / priv->n_flushes);
+
+  for (unsigned int i = 0; i < tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (tasks, i);
+
+      if (error == NULL)
+        g_task_return_boolean (task, TRUE);
+      else
+        g_task_return_error (task, g_error_copy (error));
+    }
+
+  g_clear_error (&error);
+
+  /* Release the memory held by an unusually large flush */
+  if (buffer->allocated_len > VALENT_CHANNEL_OUTPUT_MAX)
+    {
+      g_string_free (g_steal_pointer (&priv->output_data), TRUE);
+      priv->output_data = g_string_sized_new (VALENT_CHANNEL_BUFFER_SIZE);
+    }
 
   return G_SOURCE_REMOVE;
 }
@@ -841,7 +1252,8 @@ valent_channel_write_packet_func (gpointer data)
  * Send a packet over the channel.
  *
  * Internally [class@Valent.Channel] uses an outgoing packet buffer, so
- * multiple requests can be started safely from any thread.
+ * multiple requests can be started safely from any thread. Packets queued
+ * before the buffer is flushed are written together.
  *
  * Call [method@Valent.Channel.write_packet_finish] to get the result.
  *
@@ -872,11 +1284,17 @@ valent_channel_write_packet (ValentChannel       *channel,
   if (valent_channel_return_error_if_closed (channel, task))
     VALENT_EXIT;
 
-  g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer),
-                              g_task_get_priority (task),
-                              valent_channel_write_packet_func,
-                              g_object_ref (task),
-                              g_object_unref);
+  /* Schedule a flush if this is the first packet queued since the last one */
+  g_queue_push_tail (&priv->output_queue, g_object_ref (task));
+
+  if (priv->output_queue.length == 1)
+    {
+      g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer),
+                                  g_task_get_priority (task),
+                                  valent_channel_write_packets_func,
+                                  g_object_ref (channel),
+                                  g_object_unref);
+    }
 
   valent_object_unlock (VALENT_OBJECT (channel));
 
@@ -107,6 +107,15 @@ JsonNode   * valent_channel_read_packet_finish   (ValentChannel        *channel,
                                                   GAsyncResult         *result,
                                                   GError              **error);
 VALENT_AVAILABLE_IN_1_0
+void         valent_channel_read_packets         (ValentChannel        *channel,
+                                                  GCancellable         *cancellable,
+                                                  GAsyncReadyCallback   callback,
+                                                  gpointer              user_data);
+VALENT_AVAILABLE_IN_1_0
+GPtrArray  * valent_channel_read_packets_finish  (ValentChannel        *channel,
+                                                  GAsyncResult         *result,
+                                                  GError              **error);
+VALENT_AVAILABLE_IN_1_0
 void         valent_channel_write_packet         (ValentChannel        *channel,
                                                   JsonNode             *packet,
                                                   GCancellable         *cancellable,
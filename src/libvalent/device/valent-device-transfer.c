@@ -38,6 +38,7 @@ struct _ValentDeviceTransfer
   ValentDevice *device;
   GFile        *file;
   JsonNode     *packet;
+  double        throughput;
 };
 
 G_DEFINE_FINAL_TYPE (ValentDeviceTransfer, valent_device_transfer, VALENT_TYPE_TRANSFER)
@@ -48,11 +49,15 @@ enum {
   PROP_DEVICE,
   PROP_FILE,
   PROP_PACKET,
+  PROP_THROUGHPUT,
   N_PROPERTIES
 };
 
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 
+#define VALENT_TRANSFER_BUFFER_SIZE       (256 * 1024)
+#define VALENT_TRANSFER_PROGRESS_INTERVAL (250 * G_TIME_SPAN_MILLISECOND)
+
 
 static inline void
 valent_device_transfer_update_packet (JsonNode  *packet,
@@ -83,6 +88,115 @@ valent_device_transfer_update_packet (JsonNode  *packet,
   valent_packet_set_payload_size (packet, payload_size);
 }
 
+static inline void
+valent_device_transfer_set_throughput (ValentDeviceTransfer *self,
+                                       double                throughput)
+{
+  valent_object_lock (VALENT_OBJECT (self));
+  if (!G_APPROX_VALUE (self->throughput, throughput, 1.0))
+    {
+      self->throughput = throughput;
+      valent_object_notify_by_pspec (VALENT_OBJECT (self),
+                                     properties [PROP_THROUGHPUT]);
+    }
+  valent_object_unlock (VALENT_OBJECT (self));
+}
+
+/*
+ * Copy @source to @target with a large buffer, closing both streams when done.
+ *
+ * Unlike g_output_stream_splice(), which copies through a small internal
+ * buffer, this issues large reads and writes so that each TLS record is
+ * filled, and reports progress for @payload_size and the throughput at a
+ * throttled interval.
+ */
+static gssize
+valent_device_transfer_copy (ValentDeviceTransfer  *self,
+                             GInputStream          *source,
+                             GOutputStream         *target,
+                             goffset                payload_size,
+                             GCancellable          *cancellable,
+                             GError               **error)
+{
+  uint8_t *buffer;
+  gssize transferred = 0;
+  int64_t start, last_update;
+  double elapsed;
+  gboolean ret = TRUE;
+
+  g_assert (VALENT_IS_DEVICE_TRANSFER (self));
+  g_assert (G_IS_INPUT_STREAM (source));
+  g_assert (G_IS_OUTPUT_STREAM (target));
+  g_assert (error == NULL || *error == NULL);
+
+  buffer = g_aligned_alloc (1, VALENT_TRANSFER_BUFFER_SIZE, 4096);
+  start = last_update = g_get_monotonic_time ();
+
+  while (ret)
+    {
+      gssize n_read;
+      int64_t now;
+
+      n_read = g_input_stream_read (source,
+                                    buffer,
+                                    VALENT_TRANSFER_BUFFER_SIZE,
+                                    cancellable,
+                                    error);
+
+      if (n_read <= 0)
+        {
+          ret = (n_read == 0);
+          break;
+        }
+
+      ret = g_output_stream_write_all (target,
+                                       buffer,
+                                       n_read,
+                                       NULL,
+                                       cancellable,
+                                       error);
+      transferred += n_read;
+
+      now = g_get_monotonic_time ();
+      if (now - last_update >= VALENT_TRANSFER_PROGRESS_INTERVAL)
+        {
+          elapsed = (double)(now - start) / G_USEC_PER_SEC;
+          valent_device_transfer_set_throughput (self, transferred / elapsed);
+
+          if (payload_size > 0)
+            {
+              valent_transfer_set_progress (VALENT_TRANSFER (self),
+                                            MIN ((double)transferred / payload_size, 1.0));
+            }
+
+          last_update = now;
+        }
+    }
+
+  g_aligned_free (buffer);
+
+  /* Always close both streams, but only report the first error */
+  if (!g_input_stream_close (source, cancellable, ret ? error : NULL))
+    ret = FALSE;
+
+  if (!g_output_stream_close (target, cancellable, ret ? error : NULL))
+    ret = FALSE;
+
+  if (!ret)
+    return -1;
+
+  elapsed = (double)(g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+  if (elapsed > 0.0)
+    valent_device_transfer_set_throughput (self, transferred / elapsed);
+
+  VALENT_NOTE ("%"G_GSSIZE_FORMAT" bytes in %.3fs (%.1f KiB/s)",
+               transferred,
+               elapsed,
+               elapsed > 0.0 ? (transferred / elapsed) / 1024 : 0.0);
+
+  return transferred;
+}
+
 /*
  * ValentDeviceTransfer
  */
@@ -99,6 +213,7 @@ valent_device_transfer_execute_task (GTask        *task,
   g_autoptr (GIOStream) stream = NULL;
   g_autoptr (GInputStream) source = NULL;
   g_autoptr (GOutputStream) target = NULL;
+  g_autoptr (GFile) partial = NULL;
   gboolean is_download = FALSE;
   gssize transferred;
   int64_t last_modified = 0;
@@ -131,7 +246,15 @@ valent_device_transfer_execute_task (GTask        *task,
 
   if (is_download)
     {
-      target = (GOutputStream *)g_file_replace (file,
+      g_autoptr (GFile) parent = g_file_get_parent (file);
+      g_autofree char *basename = g_file_get_basename (file);
+      g_autofree char *partname = g_strconcat (basename, ".part", NULL);
+
+      /* Downloads are written to `<filename>.part` and only moved into place
+       * once the payload size is confirmed, so an interrupted download never
+       * replaces an existing file with a truncated one. */
+      partial = g_file_get_child (parent, partname);
+      target = (GOutputStream *)g_file_replace (partial,
                                                 NULL,
                                                 FALSE,
                                                 G_FILE_CREATE_REPLACE_DESTINATION,
@@ -144,7 +267,11 @@ valent_device_transfer_execute_task (GTask        *task,
       stream = valent_channel_download (channel, packet, cancellable, &error);
 
       if (stream == NULL)
-        return g_task_return_error (task, error);
+        {
+          g_output_stream_close (target, NULL, NULL);
+          g_file_delete (partial, NULL, NULL);
+          return g_task_return_error (task, error);
+        }
 
       source = g_object_ref (g_io_stream_get_input_stream (stream));
     }
@@ -180,23 +307,23 @@ valent_device_transfer_execute_task (GTask        *task,
     }
 
   /* Transfer the payload */
-  transferred = g_output_stream_splice (target,
-                                        source,
-                                        (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-                                         G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
-                                        cancellable,
-                                        &error);
+  payload_size = valent_packet_get_payload_size (packet);
+  transferred = valent_device_transfer_copy (self,
+                                             source,
+                                             target,
+                                             payload_size,
+                                             cancellable,
+                                             &error);
 
   if (error != NULL)
     {
       if (is_download)
-        g_file_delete (file, NULL, NULL);
+        g_file_delete (partial, NULL, NULL);
 
       return g_task_return_error (task, error);
     }
 
   /* If possible, confirm the transferred size with the payload size */
-  payload_size = valent_packet_get_payload_size (packet);
 
   if G_UNLIKELY (payload_size > G_MAXSSIZE)
     {
@@ -210,7 +337,7 @@ valent_device_transfer_execute_task (GTask        *task,
                G_STRFUNC, transferred, payload_size);
 
       if (is_download)
-        g_file_delete (file, NULL, NULL);
+        g_file_delete (partial, NULL, NULL);
 
       g_task_return_new_error (task,
                                G_IO_ERROR,
@@ -219,9 +346,21 @@ valent_device_transfer_execute_task (GTask        *task,
       return;
     }
 
-  /* Attempt to set file attributes for downloaded files. */
+  /* Move downloaded files into place and attempt to set file attributes. */
   if (is_download)
     {
+      if (!g_file_move (partial,
+                        file,
+                        G_FILE_COPY_OVERWRITE,
+                        cancellable,
+                        NULL,
+                        NULL,
+                        &error))
+        {
+          g_file_delete (partial, NULL, NULL);
+          return g_task_return_error (task, error);
+        }
+
       /* NOTE: this is not supported by the Linux kernel... */
       if (valent_packet_get_int (packet, "creationTime", &creation_time))
         {
@@ -338,6 +477,10 @@ valent_device_transfer_get_property (GObject    *object,
       g_value_take_boxed (value, valent_device_transfer_ref_packet (self));
       break;
 
+    case PROP_THROUGHPUT:
+      g_value_set_double (value, valent_device_transfer_get_throughput (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -436,6 +579,28 @@ valent_device_transfer_class_init (ValentDeviceTransferClass *klass)
                          G_PARAM_EXPLICIT_NOTIFY |
                          G_PARAM_STATIC_STRINGS));
 
+  /**
+   * ValentDeviceTransfer:throughput: (getter get_throughput)
+   *
+   * The average rate of the transfer, in bytes per second.
+   *
+   * This value is updated at the same interval as
+   * [property@Valent.Transfer:progress], and holds the average for the whole
+   * payload when the transfer completes.
+   *
+   * This property is thread-safe. Emissions of [signal@GObject.Object::notify]
+   * are guaranteed to happen in the main thread.
+   *
+   * Since: 1.0
+   */
+  properties [PROP_THROUGHPUT] =
+    g_param_spec_double ("throughput", NULL, NULL,
+                         0.0, G_MAXDOUBLE,
+                         0.0,
+                         (G_PARAM_READABLE |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -547,3 +712,26 @@ valent_device_transfer_ref_packet (ValentDeviceTransfer *transfer)
   return g_steal_pointer (&ret);
 }
 
+/**
+ * valent_device_transfer_get_throughput: (get-property throughput)
+ * @transfer: a #ValentDeviceTransfer
+ *
+ * Get the average rate of the transfer, in bytes per second.
+ *
+ * Returns: the throughput
+ *
+ * Since: 1.0
+ */
+double
+valent_device_transfer_get_throughput (ValentDeviceTransfer *transfer)
+{
+  double ret;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE_TRANSFER (transfer), 0.0);
+
+  valent_object_lock (VALENT_OBJECT (transfer));
+  ret = transfer->throughput;
+  valent_object_unlock (VALENT_OBJECT (transfer));
+
+  return ret;
+}
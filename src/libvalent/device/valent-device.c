@@ -1257,27 +1257,28 @@ valent_device_ref_channel (ValentDevice *device)
 }
 
 static void
-read_packet_cb (ValentChannel *channel,
-                GAsyncResult  *result,
-                ValentDevice  *device)
+read_packets_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 ValentDevice  *device)
 {
   g_autoptr (GError) error = NULL;
-  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GPtrArray) packets = NULL;
 
   g_assert (VALENT_IS_CHANNEL (channel));
   g_assert (VALENT_IS_DEVICE (device));
 
-  packet = valent_channel_read_packet_finish (channel, result, &error);
+  packets = valent_channel_read_packets_finish (channel, result, &error);
 
-  /* On success, queue another read before handling the packet */
-  if (packet != NULL)
+  /* On success, queue another read before handling the packets */
+  if (packets != NULL)
     {
-      valent_channel_read_packet (channel,
-                                  NULL,
-                                  (GAsyncReadyCallback)read_packet_cb,
-                                  g_object_ref (device));
+      valent_channel_read_packets (channel,
+                                   NULL,
+                                   (GAsyncReadyCallback)read_packets_cb,
+                                   g_object_ref (device));
 
-      valent_device_handle_packet (device, packet);
+      for (unsigned int i = 0; i < packets->len; i++)
+        valent_device_handle_packet (device, g_ptr_array_index (packets, i));
     }
 
   /* On failure, drop our reference if it's still the active channel */
@@ -1340,10 +1341,10 @@ valent_device_set_channel (ValentDevice  *device,
       valent_device_handle_identity (device, peer_identity);
 
       /* Start receiving packets */
-      valent_channel_read_packet (channel,
-                                  NULL,
-                                  (GAsyncReadyCallback)read_packet_cb,
-                                  g_object_ref (device));
+      valent_channel_read_packets (channel,
+                                   NULL,
+                                   (GAsyncReadyCallback)read_packets_cb,
+                                   g_object_ref (device));
     }
 
   valent_object_unlock (VALENT_OBJECT (device));
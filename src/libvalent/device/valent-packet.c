@@ -13,6 +13,7 @@
 
 
 G_DEFINE_QUARK (valent-packet-error, valent_packet_error)
+G_DEFINE_QUARK (valent-packet-stream, valent_packet_stream)
 
 
 /**
@@ -899,6 +900,375 @@ valent_packet_validate (JsonNode  *packet,
   return TRUE;
 }
 
+/*
+ * Packet Writer
+ *
+ * A minimal JSON serializer for KDE Connect packets, which appends directly to
+ * a caller-owned buffer instead of building intermediate strings.
+ */
+static inline void
+packet_write_int (GString *buffer,
+                  int64_t  value)
+{
+  char buf[24];
+  char *p = buf + sizeof (buf);
+  uint64_t uvalue = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+  do
+    {
+      *--p = '0' + (uvalue % 10);
+      uvalue /= 10;
+    }
+  while (uvalue != 0);
+
+  if (value < 0)
+    *--p = '-';
+
+  g_string_append_len (buffer, p, (buf + sizeof (buf)) - p);
+}
+
+static inline void
+packet_write_double (GString *buffer,
+                     double   value)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_ascii_dtostr (buf, sizeof (buf), value);
+  g_string_append (buffer, buf);
+
+  /* Ensure the value is parsed as a double, not an integer */
+  if (strpbrk (buf, ".eEn") == NULL)
+    g_string_append_len (buffer, ".0", 2);
+}
+
+static inline void
+packet_write_string (GString    *buffer,
+                     const char *str)
+{
+  const char *run = str;
+  const char *p;
+
+  g_string_append_c (buffer, '"');
+
+  for (p = str; *p != '\0'; p++)
+    {
+      unsigned char c = (unsigned char)*p;
+
+      if G_LIKELY (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+
+      g_string_append_len (buffer, run, p - run);
+      run = p + 1;
+
+      switch (c)
+        {
+        case '"':
+          g_string_append_len (buffer, "\\\"", 2);
+          break;
+
+        case '\\':
+          g_string_append_len (buffer, "\\\\", 2);
+          break;
+
+        case '\b':
+          g_string_append_len (buffer, "\\b", 2);
+          break;
+
+        case '\f':
+          g_string_append_len (buffer, "\\f", 2);
+          break;
+
+        case '\n':
+          g_string_append_len (buffer, "\\n", 2);
+          break;
+
+        case '\r':
+          g_string_append_len (buffer, "\\r", 2);
+          break;
+
+        case '\t':
+          g_string_append_len (buffer, "\\t", 2);
+          break;
+
+        default:
+          g_string_append_printf (buffer, "\\u%04x", c);
+          break;
+        }
+    }
+
+  g_string_append_len (buffer, run, p - run);
+  g_string_append_c (buffer, '"');
+}
+
+static void packet_write_node (GString  *buffer,
+                               JsonNode *node);
+
+static void
+packet_write_object (GString    *buffer,
+                     JsonObject *object)
+{
+  JsonObjectIter iter;
+  const char *name;
+  JsonNode *member;
+  gboolean first = TRUE;
+
+  g_string_append_c (buffer, '{');
+
+  json_object_iter_init_ordered (&iter, object);
+
+  while (json_object_iter_next_ordered (&iter, &name, &member))
+    {
+      if (!first)
+        g_string_append_c (buffer, ',');
+      first = FALSE;
+
+      packet_write_string (buffer, name);
+      g_string_append_c (buffer, ':');
+      packet_write_node (buffer, member);
+    }
+
+  g_string_append_c (buffer, '}');
+}
+
+static void
+packet_write_array (GString   *buffer,
+                    JsonArray *array)
+{
+  unsigned int n_elements = json_array_get_length (array);
+
+  g_string_append_c (buffer, '[');
+
+  for (unsigned int i = 0; i < n_elements; i++)
+    {
+      if (i > 0)
+        g_string_append_c (buffer, ',');
+
+      packet_write_node (buffer, json_array_get_element (array, i));
+    }
+
+  g_string_append_c (buffer, ']');
+}
+
+static void
+packet_write_node (GString  *buffer,
+                   JsonNode *node)
+{
+  switch (json_node_get_node_type (node))
+    {
+    case JSON_NODE_OBJECT:
+      packet_write_object (buffer, json_node_get_object (node));
+      break;
+
+    case JSON_NODE_ARRAY:
+      packet_write_array (buffer, json_node_get_array (node));
+      break;
+
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node))
+        {
+        case G_TYPE_INT64:
+          packet_write_int (buffer, json_node_get_int (node));
+          break;
+
+        case G_TYPE_DOUBLE:
+          packet_write_double (buffer, json_node_get_double (node));
+          break;
+
+        case G_TYPE_BOOLEAN:
+          if (json_node_get_boolean (node))
+            g_string_append_len (buffer, "true", 4);
+          else
+            g_string_append_len (buffer, "false", 5);
+          break;
+
+        case G_TYPE_STRING:
+          packet_write_string (buffer, json_node_get_string (node));
+          break;
+
+        default:
+          g_string_append_len (buffer, "null", 4);
+          break;
+        }
+      break;
+
+    case JSON_NODE_NULL:
+      g_string_append_len (buffer, "null", 4);
+      break;
+    }
+}
+
+static size_t
+packet_write (GString  *buffer,
+              JsonNode *packet,
+              int64_t   id)
+{
+  JsonObject *root = json_node_get_object (packet);
+  JsonObjectIter iter;
+  const char *name;
+  JsonNode *member;
+  size_t start = buffer->len;
+
+  /* The envelope is written first, followed by any payload fields */
+  g_string_append_len (buffer, "{\"id\":", 6);
+  packet_write_int (buffer, id);
+  g_string_append_len (buffer, ",\"type\":", 8);
+  packet_write_string (buffer, json_object_get_string_member (root, "type"));
+  g_string_append_len (buffer, ",\"body\":", 8);
+  packet_write_object (buffer, json_object_get_object_member (root, "body"));
+
+  json_object_iter_init_ordered (&iter, root);
+
+  while (json_object_iter_next_ordered (&iter, &name, &member))
+    {
+      if (g_str_equal (name, "id") ||
+          g_str_equal (name, "type") ||
+          g_str_equal (name, "body"))
+        continue;
+
+      g_string_append_c (buffer, ',');
+      packet_write_string (buffer, name);
+      g_string_append_c (buffer, ':');
+      packet_write_node (buffer, member);
+    }
+
+  g_string_append_len (buffer, "}\n", 2);
+
+  return buffer->len - start;
+}
+
+/*
+ * PacketStream:
+ *
+ * State attached to a buffered input stream, so that the parser is reused for
+ * each packet and the buffer can be returned to its initial size after a large
+ * packet has been consumed.
+ */
+typedef struct
+{
+  JsonParser *parser;
+  size_t      buffer_size;
+} PacketStream;
+
+static void
+packet_stream_free (gpointer data)
+{
+  PacketStream *state = data;
+
+  g_clear_object (&state->parser);
+  g_free (state);
+}
+
+static PacketStream *
+packet_stream_get (GBufferedInputStream *stream)
+{
+  PacketStream *state;
+
+  state = g_object_get_qdata (G_OBJECT (stream), valent_packet_stream_quark ());
+
+  if G_UNLIKELY (state == NULL)
+    {
+      state = g_new0 (PacketStream, 1);
+      state->parser = json_parser_new_immutable ();
+      state->buffer_size = g_buffered_input_stream_get_buffer_size (stream);
+      g_object_set_qdata_full (G_OBJECT (stream),
+                               valent_packet_stream_quark (),
+                               state,
+                               packet_stream_free);
+    }
+
+  return state;
+}
+
+static JsonNode *
+valent_packet_from_buffered_stream (GBufferedInputStream  *stream,
+                                    gssize                 max_len,
+                                    GCancellable          *cancellable,
+                                    GError               **error)
+{
+  PacketStream *state = packet_stream_get (stream);
+  g_autoptr (JsonNode) packet = NULL;
+  const char *buffer = NULL;
+  const char *eol = NULL;
+  size_t available = 0;
+  size_t scanned = 0;
+  size_t line_len = 0;
+  gboolean parsed;
+
+  while (TRUE)
+    {
+      size_t buffer_size;
+      gssize read;
+
+      buffer = g_buffered_input_stream_peek_buffer (stream, &available);
+
+      if (available > scanned)
+        eol = memchr (buffer + scanned, '\n', available - scanned);
+
+      if (eol != NULL)
+        {
+          line_len = (eol - buffer) + 1;
+          break;
+        }
+
+      if G_UNLIKELY (available >= (size_t)max_len)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_MESSAGE_TOO_LARGE,
+                       "Packet too large");
+          return NULL;
+        }
+
+      /* If the buffer is full, grow it so the next fill makes progress */
+      buffer_size = g_buffered_input_stream_get_buffer_size (stream);
+
+      if (available == buffer_size)
+        {
+          buffer_size = MIN (buffer_size * 2, (size_t)max_len);
+          g_buffered_input_stream_set_buffer_size (stream, buffer_size);
+        }
+
+      scanned = available;
+      read = g_buffered_input_stream_fill (stream, -1, cancellable, error);
+
+      if (read < 0)
+        return NULL;
+
+      if (read == 0)
+        {
+          line_len = available;
+          break;
+        }
+    }
+
+  if G_UNLIKELY (line_len > (size_t)max_len)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_MESSAGE_TOO_LARGE,
+                   "Packet too large");
+      return NULL;
+    }
+
+  /* Parse the line in-place, then consume it from the buffer */
+  parsed = json_parser_load_from_data (state->parser, buffer, line_len, error);
+  packet = json_parser_steal_root (state->parser);
+  g_input_stream_skip (G_INPUT_STREAM (stream), line_len, NULL, NULL);
+
+  /* Shrink the buffer once the data for a large packet has been consumed */
+  if (g_buffered_input_stream_get_buffer_size (stream) > state->buffer_size &&
+      g_buffered_input_stream_get_available (stream) <= state->buffer_size)
+    g_buffered_input_stream_set_buffer_size (stream, state->buffer_size);
+
+  if (!parsed)
+    return NULL;
+
+  if (!valent_packet_validate (packet, error))
+    return NULL;
+
+  return g_steal_pointer (&packet);
+}
+
 /**
  * valent_packet_from_stream:
  * @stream: a #GInputStream
@@ -915,6 +1285,13 @@ valent_packet_validate (JsonNode  *packet,
  * If @max_len bytes are read without encountering a line-feed character, %NULL
  * will be returned with @error set to %G_IO_ERROR_MESSAGE_TOO_LARGE.
  *
+ * If @stream is a [class@Gio.BufferedInputStream], data is read in chunks and
+ * parsed directly from the buffer, and any bytes following the line-feed are
+ * left in the buffer for the next call. The parser state is reused for each
+ * packet read from the same stream.
+ * Otherwise the stream is read one byte at a time, so that no data past the
+ * end of the packet is consumed (e.g. before a TLS handshake).
+ *
  * Returns: (transfer full): a KDE Connect packet, or %NULL with @error set.
  *
  * Since: 1.0
@@ -939,6 +1316,14 @@ valent_packet_from_stream (GInputStream  *stream,
   if (max_len < 0)
     max_len = G_MAXSSIZE;
 
+  if (G_IS_BUFFERED_INPUT_STREAM (stream))
+    {
+      return valent_packet_from_buffered_stream (G_BUFFERED_INPUT_STREAM (stream),
+                                                 max_len,
+                                                 cancellable,
+                                                 error);
+    }
+
   line = g_malloc0 (size);
 
   while (TRUE)
@@ -1010,10 +1395,9 @@ valent_packet_to_stream (GOutputStream  *stream,
                          GCancellable   *cancellable,
                          GError        **error)
 {
-  g_autoptr (JsonGenerator) generator = NULL;
+  g_autoptr (GString) packet_str = NULL;
   JsonObject *root;
-  g_autofree char *packet_str = NULL;
-  size_t packet_len;
+  int64_t id;
   size_t n_written;
 
   g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
@@ -1024,24 +1408,23 @@ valent_packet_to_stream (GOutputStream  *stream,
     return FALSE;
 
   /* Timestamp the packet (UNIX Epoch ms) */
+  id = valent_timestamp_ms ();
   root = json_node_get_object (packet);
-  json_object_set_int_member (root, "id", valent_timestamp_ms ());
+  json_object_set_int_member (root, "id", id);
 
-  /* Serialize the packet and replace the trailing NULL with an LF */
-  generator = json_generator_new ();
-  json_generator_set_root (generator, packet);
-  packet_str = json_generator_to_data (generator, &packet_len);
-  packet_str[packet_len++] = '\n';
+  /* Serialize the packet with a trailing LF */
+  packet_str = g_string_sized_new (4096);
+  packet_write (packet_str, packet, id);
 
   if (!g_output_stream_write_all (stream,
-                                  packet_str,
-                                  packet_len,
+                                  packet_str->str,
+                                  packet_str->len,
                                   &n_written,
                                   cancellable,
                                   error))
     return FALSE;
 
-  if (n_written != packet_len)
+  if (n_written != packet_str->len)
     {
       g_set_error (error,
                    G_IO_ERROR,
@@ -1067,22 +1450,47 @@ valent_packet_to_stream (GOutputStream  *stream,
 char *
 valent_packet_serialize (JsonNode *packet)
 {
-  g_autoptr (JsonGenerator) generator = NULL;
+  GString *packet_str;
   JsonObject *root;
-  g_autofree char *packet_str = NULL;
+  int64_t id;
 
   g_return_val_if_fail (VALENT_IS_PACKET (packet), NULL);
 
   /* Timestamp the packet (UNIX Epoch ms) */
+  id = valent_timestamp_ms ();
   root = json_node_get_object (packet);
-  json_object_set_int_member (root, "id", valent_timestamp_ms ());
+  json_object_set_int_member (root, "id", id);
 
   /* Stringify the packet and return a newline-terminated string */
-  generator = json_generator_new ();
-  json_generator_set_root (generator, packet);
-  packet_str = json_generator_to_data (generator, NULL);
+  packet_str = g_string_sized_new (4096);
+  packet_write (packet_str, packet, id);
+
+  return g_string_free (packet_str, FALSE);
+}
+
+/**
+ * valent_packet_to_gstring:
+ * @packet: a complete KDE Connect packet
+ * @string: a #GString
+ *
+ * Serialize a KDE Connect packet, appending it to @string.
+ *
+ * The packet is written with a newline ending, ready to be written to a
+ * stream. Unlike [func@Valent.packet_serialize], the `id` field is written
+ * with the current timestamp without modifying @packet.
+ *
+ * Returns: the number of bytes appended to @string
+ *
+ * Since: 1.0
+ */
+size_t
+valent_packet_to_gstring (JsonNode *packet,
+                          GString  *string)
+{
+  g_return_val_if_fail (VALENT_IS_PACKET (packet), 0);
+  g_return_val_if_fail (string != NULL, 0);
 
-  return g_strconcat (packet_str, "\n", NULL);
+  return packet_write (string, packet, valent_timestamp_ms ());
 }
 
 /**
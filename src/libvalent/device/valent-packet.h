@@ -174,6 +174,9 @@ gboolean     valent_packet_to_stream        (GOutputStream  *stream,
 VALENT_AVAILABLE_IN_1_0
 char       * valent_packet_serialize        (JsonNode       *packet);
 VALENT_AVAILABLE_IN_1_0
+size_t       valent_packet_to_gstring       (JsonNode       *packet,
+                                             GString        *string);
+VALENT_AVAILABLE_IN_1_0
 JsonNode   * valent_packet_deserialize      (const char     *json,
                                              GError        **error);
 
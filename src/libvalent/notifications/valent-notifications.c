@@ -33,7 +33,9 @@ struct _ValentNotifications
 {
   ValentComponent  parent_instance;
 
-  GVariant        *applications;
+  GHashTable      *applications;
+  GVariant        *snapshot;
+  gboolean         applications_loaded;
 };
 
 G_DEFINE_FINAL_TYPE (ValentNotifications, valent_notifications, VALENT_TYPE_COMPONENT)
@@ -50,44 +52,40 @@ static guint signals[N_SIGNALS] = { 0, };
 static ValentNotifications *default_listener = NULL;
 
 
-static GVariant *
-app_info_serialize (GAppInfo *info)
+/*
+ * Application Registry
+ *
+ * Applications are held in a table of names to icons, updated in place as
+ * notifications arrive. The desktop applications known to send notifications
+ * are scanned in a thread, and the GVariant dictionary is only built when
+ * requested, then reused until the table changes.
+ */
+static void
+application_icon_free (gpointer data)
 {
-  GVariantDict dict;
-  const char *name;
-  GIcon *icon;
-
-  g_assert (G_IS_APP_INFO (info));
-
-  g_variant_dict_init (&dict, NULL);
-
-  if ((name = g_app_info_get_display_name (info)) != NULL)
-    g_variant_dict_insert (&dict, "name", "s", name);
-
-  if ((icon = g_app_info_get_icon (info)) != NULL)
-    {
-      g_autoptr (GVariant) iconv = NULL;
-
-      iconv = g_icon_serialize (icon);
-      g_variant_dict_insert_value (&dict, "icon", iconv);
-    }
+  if (data != NULL)
+    g_object_unref (data);
+}
 
-  return g_variant_dict_end (&dict);
+static GHashTable *
+application_table_new (void)
+{
+  return g_hash_table_new_full (g_str_hash,
+                                g_str_equal,
+                                g_free,
+                                application_icon_free);
 }
 
 static GVariant *
-notification_serialize (ValentNotification *notification)
+application_serialize (const char *name,
+                       GIcon      *icon)
 {
   GVariantDict dict;
-  const char *app_name;
-  GIcon *icon;
 
   g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, "name", "s", name);
 
-  if ((app_name = valent_notification_get_application (notification)) != NULL)
-    g_variant_dict_insert (&dict, "name", "s", app_name);
-
-  if ((icon = valent_notification_get_icon (notification)) != NULL)
+  if (icon != NULL)
     {
       g_autoptr (GVariant) iconv = NULL;
 
@@ -98,21 +96,20 @@ notification_serialize (ValentNotification *notification)
   return g_variant_dict_end (&dict);
 }
 
-static void
-query_applications (ValentNotifications *self)
+static GHashTable *
+query_applications (void)
 {
-  GVariantDict dict;
+  g_autoptr (GHashTable) applications = NULL;
   g_autolist (GAppInfo) infos = NULL;
 
-  g_assert (VALENT_IS_NOTIFICATIONS (self));
-
-  g_variant_dict_init (&dict, NULL);
+  applications = application_table_new ();
   infos = g_app_info_get_all ();
 
   for (const GList *iter = infos; iter; iter = iter->next)
     {
       const char *desktop_id;
       const char *name;
+      GIcon *icon;
 
       desktop_id = g_app_info_get_id (iter->data);
 
@@ -122,31 +119,103 @@ query_applications (ValentNotifications *self)
       if (!g_desktop_app_info_get_boolean (iter->data, "X-GNOME-UsesNotifications"))
         continue;
 
-      name = g_app_info_get_display_name (iter->data);
-      g_variant_dict_insert_value (&dict, name, app_info_serialize (iter->data));
+      if ((name = g_app_info_get_display_name (iter->data)) == NULL)
+        continue;
+
+      icon = g_app_info_get_icon (iter->data);
+      g_hash_table_replace (applications,
+                            g_strdup (name),
+                            icon ? g_object_ref (icon) : NULL);
     }
 
-  self->applications = g_variant_ref_sink (g_variant_dict_end (&dict));
+  return g_steal_pointer (&applications);
+}
+
+static void
+query_applications_task (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  g_task_return_pointer (task,
+                         query_applications (),
+                         (GDestroyNotify)g_hash_table_unref);
+}
+
+static void
+merge_applications (ValentNotifications *self,
+                    GHashTable          *applications)
+{
+  GHashTableIter iter;
+  gpointer name, icon;
+
+  g_assert (VALENT_IS_NOTIFICATIONS (self));
+
+  /* Applications seen in notifications take precedence */
+  g_hash_table_iter_init (&iter, applications);
+
+  while (g_hash_table_iter_next (&iter, &name, &icon))
+    {
+      if (g_hash_table_contains (self->applications, name))
+        continue;
+
+      g_hash_table_iter_steal (&iter);
+      g_hash_table_insert (self->applications, name, icon);
+    }
+
+  self->applications_loaded = TRUE;
+  g_clear_pointer (&self->snapshot, g_variant_unref);
+}
+
+static void
+query_applications_cb (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+  GWeakRef *weak_ref = user_data;
+  g_autoptr (ValentNotifications) self = NULL;
+  g_autoptr (GHashTable) applications = NULL;
+
+  applications = g_task_propagate_pointer (G_TASK (result), NULL);
+  self = g_weak_ref_get (weak_ref);
+  g_weak_ref_clear (weak_ref);
+  g_free (weak_ref);
+
+  /* The scan may have been superseded by a synchronous query */
+  if (self == NULL || applications == NULL || self->applications_loaded)
+    return;
+
+  merge_applications (self, applications);
 }
 
 static void
 add_application (ValentNotifications *self,
-                 GVariant            *application)
+                 ValentNotification  *notification)
 {
-  GVariantDict dict;
   const char *name;
+  GIcon *icon;
+  gpointer current;
 
-  if (self->applications == NULL)
-    query_applications (self);
+  if ((name = valent_notification_get_application (notification)) == NULL)
+    return;
 
-  g_variant_dict_init (&dict, self->applications);
+  icon = valent_notification_get_icon (notification);
 
-  if (g_variant_lookup (application, "name", "&s", &name))
-    g_variant_dict_insert_value (&dict, name, g_variant_ref_sink (application));
-  g_variant_unref (application);
+  /* Most notifications are from a known application with the same icon, or
+   * no icon at all, in which case the existing entry is kept */
+  if (g_hash_table_lookup_extended (self->applications, name, NULL, &current))
+    {
+      if (icon == NULL || (current != NULL && g_icon_equal (current, icon)))
+        return;
+    }
 
-  g_clear_pointer (&self->applications, g_variant_unref);
-  self->applications = g_variant_ref_sink (g_variant_dict_end (&dict));
+  g_hash_table_replace (self->applications,
+                        g_strdup (name),
+                        icon ? g_object_ref (icon) : NULL);
+  g_clear_pointer (&self->snapshot, g_variant_unref);
 }
 
 
@@ -162,7 +231,7 @@ on_notification_added (ValentNotificationsAdapter *adapter,
   g_assert (VALENT_IS_NOTIFICATION (notification));
   g_assert (VALENT_IS_NOTIFICATIONS (self));
 
-  add_application (self, notification_serialize (notification));
+  add_application (self, notification);
 
   g_signal_emit (G_OBJECT (self), signals [NOTIFICATION_ADDED], 0, notification);
 }
@@ -226,12 +295,31 @@ valent_notifications_unbind_extension (ValentComponent *component,
 /*
  * GObject
  */
+static void
+valent_notifications_constructed (GObject *object)
+{
+  ValentNotifications *self = VALENT_NOTIFICATIONS (object);
+  g_autoptr (GTask) task = NULL;
+  GWeakRef *weak_ref;
+
+  G_OBJECT_CLASS (valent_notifications_parent_class)->constructed (object);
+
+  /* The task holds a weak reference, so it doesn't keep the object alive */
+  weak_ref = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (weak_ref, self);
+
+  task = g_task_new (NULL, NULL, query_applications_cb, weak_ref);
+  g_task_set_source_tag (task, valent_notifications_constructed);
+  g_task_run_in_thread (task, query_applications_task);
+}
+
 static void
 valent_notifications_finalize (GObject *object)
 {
   ValentNotifications *self = VALENT_NOTIFICATIONS (object);
 
-  g_clear_pointer (&self->applications, g_variant_unref);
+  g_clear_pointer (&self->applications, g_hash_table_unref);
+  g_clear_pointer (&self->snapshot, g_variant_unref);
 
   G_OBJECT_CLASS (valent_notifications_parent_class)->finalize (object);
 }
@@ -242,6 +330,7 @@ valent_notifications_class_init (ValentNotificationsClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   ValentComponentClass *component_class = VALENT_COMPONENT_CLASS (klass);
 
+  object_class->constructed = valent_notifications_constructed;
   object_class->finalize = valent_notifications_finalize;
 
   component_class->bind_extension = valent_notifications_bind_extension;
@@ -295,7 +384,7 @@ valent_notifications_class_init (ValentNotificationsClass *klass)
 static void
 valent_notifications_init (ValentNotifications *self)
 {
-  query_applications (self);
+  self->applications = application_table_new ();
 }
 
 /**
@@ -342,9 +431,30 @@ valent_notifications_get_applications (ValentNotifications *notifications)
   if (notifications == NULL)
       notifications = valent_notifications_get_default ();
 
-  if (notifications->applications == NULL)
-    query_applications (notifications);
+  /* If the scan is still running, query the applications directly */
+  if (!notifications->applications_loaded)
+    {
+      g_autoptr (GHashTable) applications = NULL;
+
+      applications = query_applications ();
+      merge_applications (notifications, applications);
+    }
+
+  if (notifications->snapshot == NULL)
+    {
+      GVariantDict dict;
+      GHashTableIter iter;
+      gpointer name, icon;
+
+      g_variant_dict_init (&dict, NULL);
+      g_hash_table_iter_init (&iter, notifications->applications);
+
+      while (g_hash_table_iter_next (&iter, &name, &icon))
+        g_variant_dict_insert_value (&dict, name, application_serialize (name, icon));
+
+      notifications->snapshot = g_variant_ref_sink (g_variant_dict_end (&dict));
+    }
 
-  return notifications->applications;
+  return notifications->snapshot;
 }
 
@@ -11,6 +11,12 @@
 
 #include "valent-clipboard-plugin.h"
 
+/* Content larger than this is only sent when explicitly pushed */
+#define CLIPBOARD_CONTENT_MAX (1024 * 1024)
+
+/* The last `kdeconnect.clipboard` packet, shared by all devices */
+#define CLIPBOARD_PACKET_KEY  "valent-clipboard-plugin-packet"
+
 
 struct _ValentClipboardPlugin
 {
@@ -36,18 +42,32 @@ static void
 valent_clipboard_plugin_clipboard (ValentClipboardPlugin *self,
                                    const char            *content)
 {
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
+  JsonNode *packet = NULL;
 
   g_return_if_fail (VALENT_IS_CLIPBOARD_PLUGIN (self));
 
   if (content == NULL)
     return;
 
-  valent_packet_init (&builder, "kdeconnect.clipboard");
-  json_builder_set_member_name (builder, "content");
-  json_builder_add_string_value (builder, content);
-  packet = valent_packet_end (&builder);
+  /* Each change is usually sent to every connected device, so the packet is
+   * built once and shared until the content changes */
+  packet = g_object_get_data (G_OBJECT (self->clipboard), CLIPBOARD_PACKET_KEY);
+
+  if (packet == NULL ||
+      g_strcmp0 (json_object_get_string_member (valent_packet_get_body (packet), "content"), content) != 0)
+    {
+      g_autoptr (JsonBuilder) builder = NULL;
+
+      valent_packet_init (&builder, "kdeconnect.clipboard");
+      json_builder_set_member_name (builder, "content");
+      json_builder_add_string_value (builder, content);
+      packet = valent_packet_end (&builder);
+
+      g_object_set_data_full (G_OBJECT (self->clipboard),
+                              CLIPBOARD_PACKET_KEY,
+                              packet,
+                              (GDestroyNotify)json_node_unref);
+    }
 
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
 }
@@ -76,9 +96,10 @@ valent_clipboard_plugin_clipboard_connect (ValentClipboardPlugin *self,
 }
 
 static void
-valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
-                               GAsyncResult          *result,
-                               ValentClipboardPlugin *self)
+valent_clipboard_plugin_push_text (ValentClipboardPlugin *self,
+                                   ValentClipboard       *clipboard,
+                                   GAsyncResult          *result,
+                                   size_t                 max_size)
 {
   g_autoptr (GError) error = NULL;
   g_autofree char *text = NULL;
@@ -100,9 +121,33 @@ valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
   if (text == NULL || g_strcmp0 (self->remote_text, text) == 0)
     return;
 
+  if (strlen (text) > max_size)
+    {
+      g_debug ("%s(): skipping clipboard content larger than %zu bytes",
+               G_STRFUNC, max_size);
+      return;
+    }
+
   valent_clipboard_plugin_clipboard (self, text);
 }
 
+static void
+valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
+                               GAsyncResult          *result,
+                               ValentClipboardPlugin *self)
+{
+  valent_clipboard_plugin_push_text (self, clipboard, result, G_MAXSIZE);
+}
+
+/* Large content is left for an explicit push */
+static void
+valent_clipboard_read_text_auto_cb (ValentClipboard       *clipboard,
+                                    GAsyncResult          *result,
+                                    ValentClipboardPlugin *self)
+{
+  valent_clipboard_plugin_push_text (self, clipboard, result, CLIPBOARD_CONTENT_MAX);
+}
+
 static void
 valent_clipboard_read_text_connect_cb (ValentClipboard       *clipboard,
                                        GAsyncResult          *result,
@@ -124,7 +169,7 @@ valent_clipboard_read_text_connect_cb (ValentClipboard       *clipboard,
       return;
     }
 
-  if (text == NULL)
+  if (text == NULL || strlen (text) > CLIPBOARD_CONTENT_MAX)
     return;
 
   valent_clipboard_plugin_clipboard_connect (self, text, self->local_timestamp);
@@ -203,7 +248,7 @@ on_auto_push_changed (GSettings             *settings,
   destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
   valent_clipboard_read_text (valent_clipboard_get_default (),
                               destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
+                              (GAsyncReadyCallback)valent_clipboard_read_text_auto_cb,
                               self);
 
 }
@@ -225,7 +270,7 @@ on_clipboard_changed (ValentClipboard       *clipboard,
   destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
   valent_clipboard_read_text (clipboard,
                               destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
+                              (GAsyncReadyCallback)valent_clipboard_read_text_auto_cb,
                               self);
 }
 
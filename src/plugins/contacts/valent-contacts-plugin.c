@@ -20,6 +20,7 @@ struct _ValentContactsPlugin
 
   ValentContactStore *local_store;
   ValentContactStore *remote_store;
+  GHashTable         *timestamps;
 };
 
 G_DEFINE_FINAL_TYPE (ValentContactsPlugin, valent_contacts_plugin, VALENT_TYPE_DEVICE_PLUGIN)
@@ -219,23 +220,182 @@ valent_contact_plugin_handle_request_all_uids_timestamps (ValentContactsPlugin *
 /*
  * Remote Contacts
  */
+#define VALENT_CONTACTS_REQUEST_BATCH (100)
+#define VALENT_CONTACTS_TIMESTAMP     "X-KDECONNECT-TIMESTAMP"
+
+typedef struct
+{
+  ValentContactsPlugin *plugin;
+  GHashTable           *timestamps;
+} ContactsSync;
+
+static void
+contacts_sync_free (gpointer data)
+{
+  ContactsSync *sync = data;
+
+  g_clear_pointer (&sync->timestamps, g_hash_table_unref);
+  g_free (sync);
+}
+
+static inline int64_t
+valent_contact_get_timestamp (EContact *contact)
+{
+  EVCardAttribute *attr;
+  g_autofree char *value = NULL;
+
+  attr = e_vcard_get_attribute (E_VCARD (contact), VALENT_CONTACTS_TIMESTAMP);
+
+  if (attr == NULL || (value = e_vcard_attribute_get_value (attr)) == NULL)
+    return 0;
+
+  return g_ascii_strtoll (value, NULL, 10);
+}
+
+static void
+valent_contacts_plugin_request_vcards (ValentContactsPlugin *self,
+                                       GPtrArray            *uids)
+{
+  g_assert (VALENT_IS_CONTACTS_PLUGIN (self));
+  g_assert (uids != NULL);
+
+  for (unsigned int i = 0; i < uids->len; i += VALENT_CONTACTS_REQUEST_BATCH)
+    {
+      g_autoptr (JsonBuilder) builder = NULL;
+      g_autoptr (JsonNode) request = NULL;
+      unsigned int n_batch = MIN (uids->len - i, VALENT_CONTACTS_REQUEST_BATCH);
+
+      valent_packet_init (&builder, "kdeconnect.contacts.request_vcards_by_uid");
+      json_builder_set_member_name (builder, "uids");
+      json_builder_begin_array (builder);
+
+      for (unsigned int j = i; j < i + n_batch; j++)
+        json_builder_add_string_value (builder, g_ptr_array_index (uids, j));
+
+      json_builder_end_array (builder);
+      request = valent_packet_end (&builder);
+
+      valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), request);
+    }
+}
+
+static void
+valent_contact_store_remove_contacts_cb (ValentContactStore *store,
+                                         GAsyncResult       *result,
+                                         gpointer            user_data)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (!valent_contact_store_remove_contacts_finish (store, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("%s(): %s", G_STRFUNC, error->message);
+}
+
+static void
+valent_contact_store_query_timestamps_cb (ValentContactStore *store,
+                                          GAsyncResult       *result,
+                                          gpointer            user_data)
+{
+  ContactsSync *sync = user_data;
+  ValentContactsPlugin *self = sync->plugin;
+  g_autoslist (GObject) contacts = NULL;
+  g_autoptr (GHashTable) known = NULL;
+  g_autoptr (GPtrArray) requests = NULL;
+  g_autoptr (GSList) removals = NULL;
+  g_autoptr (GError) error = NULL;
+  GHashTableIter iter;
+  const char *uid;
+  int64_t *timestamp;
+
+  contacts = valent_contact_store_query_finish (store, result, &error);
+
+  /* If the operation was cancelled, we're about to dispose */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      contacts_sync_free (sync);
+      return;
+    }
+
+  if (error != NULL)
+    g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+  /* Diff the cached timestamps against the device's */
+  known = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (const GSList *citer = contacts; citer; citer = citer->next)
+    {
+      int64_t *remote_timestamp = NULL;
+
+      uid = e_contact_get_const (citer->data, E_CONTACT_UID);
+
+      if (uid == NULL)
+        continue;
+
+      if (!g_hash_table_lookup_extended (sync->timestamps,
+                                         uid,
+                                         NULL,
+                                         (void **)&remote_timestamp))
+        {
+          removals = g_slist_prepend (removals, (char *)uid);
+          continue;
+        }
+
+      if (*remote_timestamp == valent_contact_get_timestamp (citer->data))
+        g_hash_table_add (known, (char *)uid);
+    }
+
+  requests = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, sync->timestamps);
+
+  while (g_hash_table_iter_next (&iter, (void **)&uid, (void **)&timestamp))
+    {
+      if (g_hash_table_contains (known, uid))
+        continue;
+
+      g_ptr_array_add (requests, (char *)uid);
+      g_hash_table_replace (self->timestamps,
+                            g_strdup (uid),
+                            g_memdup2 (timestamp, sizeof (int64_t)));
+    }
+
+  VALENT_NOTE ("%u unchanged, %u requested, %u removed",
+               g_hash_table_size (known),
+               requests->len,
+               g_slist_length (removals));
+
+  if (removals != NULL)
+    {
+      valent_contact_store_remove_contacts (self->remote_store,
+                                            removals,
+                                            self->cancellable,
+                                            (GAsyncReadyCallback)valent_contact_store_remove_contacts_cb,
+                                            NULL);
+    }
+
+  if (requests->len > 0)
+    valent_contacts_plugin_request_vcards (self, requests);
+
+  contacts_sync_free (sync);
+}
+
 static void
 valent_contact_plugin_handle_response_uids_timestamps (ValentContactsPlugin *self,
                                                        JsonNode             *packet)
 {
-  g_autoptr (JsonNode) request = NULL;
-  g_autoptr (JsonBuilder) builder = NULL;
+  static const char * const fields[] = { VALENT_CONTACTS_TIMESTAMP, NULL };
+  ContactsSync *sync = NULL;
+  g_autoptr (EBookQuery) query = NULL;
+  g_autofree char *sexp = NULL;
   JsonObjectIter iter;
   const char *uid;
   JsonNode *node;
-  unsigned int n_requested = 0;
 
   g_assert (VALENT_IS_CONTACTS_PLUGIN (self));
 
-  /* Start the packet */
-  valent_packet_init (&builder, "kdeconnect.contacts.request_vcards_by_uid");
-  json_builder_set_member_name (builder, "uids");
-  json_builder_begin_array (builder);
+  sync = g_new0 (ContactsSync, 1);
+  sync->plugin = self;
+  sync->timestamps = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
 
   json_object_iter_init (&iter, valent_packet_get_body (packet));
 
@@ -250,20 +410,21 @@ valent_contact_plugin_handle_response_uids_timestamps (ValentContactsPlugin *sel
       if G_LIKELY (json_node_get_value_type (node) == G_TYPE_INT64)
         timestamp = json_node_get_int (node);
 
-      /* Check if the contact is new or updated */
-      if (0 != timestamp)
-      //if (valent_contact_store_get_timestamp (self->store, uid) != timestamp)
-        {
-          n_requested++;
-          json_builder_add_string_value (builder, uid);
-        }
+      g_hash_table_replace (sync->timestamps,
+                            g_strdup (uid),
+                            g_memdup2 (&timestamp, sizeof (int64_t)));
     }
 
-  json_builder_end_array (builder);
-  request = valent_packet_end (&builder);
+  /* Compare against the timestamps stored with the cached vCards */
+  query = e_book_query_vcard_field_exists (EVC_UID);
+  sexp = e_book_query_to_string (query);
 
-  if (n_requested > 0)
-    valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), request);
+  valent_contact_store_query_fields (self->remote_store,
+                                     sexp,
+                                     fields,
+                                     self->cancellable,
+                                     (GAsyncReadyCallback)valent_contact_store_query_timestamps_cb,
+                                     sync);
 }
 
 static void
@@ -287,6 +448,7 @@ valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
   JsonObjectIter iter;
   const char *uid;
   JsonNode *node;
+  int64_t *timestamp;
 
   g_assert (VALENT_IS_CONTACTS_PLUGIN (self));
 
@@ -306,9 +468,29 @@ valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
       vcard = json_node_get_string (node);
       contact = e_contact_new_from_vcard_with_uid (vcard, uid);
 
-      contacts = g_slist_append (contacts, contact);
+      /* Ensure the timestamp is stored with the contact, for the next sync */
+      if ((timestamp = g_hash_table_lookup (self->timestamps, uid)) != NULL)
+        {
+          if (valent_contact_get_timestamp (contact) != *timestamp)
+            {
+              g_autofree char *value = NULL;
+
+              value = g_strdup_printf ("%"G_GINT64_FORMAT, *timestamp);
+              e_vcard_remove_attributes (E_VCARD (contact),
+                                         NULL,
+                                         VALENT_CONTACTS_TIMESTAMP);
+              e_vcard_append_attribute_with_value (E_VCARD (contact),
+                                                   e_vcard_attribute_new (NULL, VALENT_CONTACTS_TIMESTAMP),
+                                                   value);
+            }
+
+          g_hash_table_remove (self->timestamps, uid);
+        }
+
+      contacts = g_slist_prepend (contacts, contact);
     }
 
+  /* Each response is written to the cache in a single transaction */
   if (contacts != NULL)
     {
       valent_contact_store_add_contacts (self->remote_store,
@@ -464,6 +646,7 @@ valent_contacts_plugin_dispose (GObject *object)
   g_clear_object (&self->cancellable);
   g_clear_object (&self->remote_store);
   g_clear_object (&self->local_store);
+  g_clear_pointer (&self->timestamps, g_hash_table_unref);
 
   G_OBJECT_CLASS (valent_contacts_plugin_parent_class)->dispose (object);
 }
@@ -484,5 +667,7 @@ valent_contacts_plugin_class_init (ValentContactsPluginClass *klass)
 static void
 valent_contacts_plugin_init (ValentContactsPlugin *self)
 {
+  self->timestamps = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
 }
 
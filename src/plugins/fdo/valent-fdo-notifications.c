@@ -11,6 +11,12 @@
 
 #include "valent-fdo-notifications.h"
 
+/* The maximum number of recent image-data icons kept for deduplication */
+#define IMAGE_CACHE_SIZE (8)
+
+/* The number of pixel bytes sampled for the image-data cache key */
+#define IMAGE_HASH_SAMPLES (64)
+
 
 struct _ValentFdoNotifications
 {
@@ -25,6 +31,7 @@ struct _ValentFdoNotifications
   unsigned int                name_owner_id;
   GDBusConnection            *session;
   unsigned int                closed_id;
+  GQueue                      images;
 };
 
 static void   g_async_initable_iface_init (GAsyncInitableIface *iface);
@@ -70,17 +77,74 @@ static const char *interface_matches[] = {
 };
 
 
+typedef struct
+{
+  GdkPixbuf    *pixbuf;
+  GBytes       *pixels;
+  unsigned int  hash;
+} ImageEntry;
+
+static void
+image_entry_free (gpointer data)
+{
+  ImageEntry *entry = data;
+
+  g_clear_object (&entry->pixbuf);
+  g_clear_pointer (&entry->pixels, g_bytes_unref);
+  g_free (entry);
+}
+
+/*
+ * Hash the dimensions of an image and a sample of its pixels, spread across
+ * the data. This is cheap for large images and only used to find candidates;
+ * a match is confirmed by comparing the pixels.
+ */
+static unsigned int
+image_data_hash (GBytes  *pixels,
+                 int32_t  width,
+                 int32_t  height,
+                 int32_t  rowstride,
+                 gboolean has_alpha)
+{
+  const uint8_t *data;
+  size_t size = 0;
+  size_t step;
+  unsigned int hash;
+
+  data = g_bytes_get_data (pixels, &size);
+  hash = (unsigned int)width;
+  hash = (hash * 31) + (unsigned int)height;
+  hash = (hash * 31) + (unsigned int)rowstride;
+  hash = (hash * 31) + (unsigned int)has_alpha;
+
+  step = MAX (size / IMAGE_HASH_SAMPLES, 1);
+
+  for (size_t i = 0; i < size; i += step)
+    hash = (hash * 31) + data[i];
+
+  return (hash * 31) + data[size - 1];
+}
+
+/*
+ * Create a GdkPixbuf for @image_data, backed by the serialized data of the
+ * variant instead of a copy. Identical images are deduplicated by content, so
+ * repeated notifications share one icon and any encoding cached for it; the
+ * image is scaled and encoded later, by the consumer.
+ */
 static GIcon *
-_g_icon_new_for_variant (GVariant *image_data)
+_g_icon_new_for_variant (ValentFdoNotifications *self,
+                         GVariant               *image_data)
 {
-  GdkPixbuf *pixbuf;
+  g_autoptr (GBytes) pixels = NULL;
+  g_autoptr (GdkPixbuf) pixbuf = NULL;
+  ImageEntry *entry;
   int32_t width, height, rowstride;
   gboolean has_alpha;
   int32_t bits_per_sample, n_channels;
   g_autoptr (GVariant) data_variant = NULL;
-  guchar *data = NULL;
   size_t data_len = 0;
   size_t expected_len = 0;
+  unsigned int hash;
 
   g_variant_get (image_data, "(iiibii@ay)",
                  &width,
@@ -91,8 +155,18 @@ _g_icon_new_for_variant (GVariant *image_data)
                  &n_channels,
                  &data_variant);
 
+  /* GdkPixbuf only supports 8-bit RGB(A), with each row holding every pixel */
+  if (width <= 0 || height <= 0 || rowstride <= 0 ||
+      bits_per_sample != 8 || n_channels != (has_alpha ? 4 : 3) ||
+      (int64_t)rowstride < (int64_t)width * n_channels)
+    {
+      g_warning ("Unsupported image data (%ix%i, %i bits, %i channels, %i rowstride)",
+                 width, height, bits_per_sample, n_channels, rowstride);
+      return NULL;
+    }
+
   data_len = g_variant_get_size (data_variant);
-  expected_len = (height - 1) * rowstride + width
+  expected_len = (size_t)(height - 1) * rowstride + (size_t)width
     * ((n_channels * bits_per_sample + 7) / 8);
 
   if (expected_len != data_len)
@@ -104,18 +178,51 @@ _g_icon_new_for_variant (GVariant *image_data)
       return NULL;
     }
 
-  data = g_memdup2 (g_variant_get_data (data_variant), data_len);
-  pixbuf = gdk_pixbuf_new_from_data (data,
-                                     GDK_COLORSPACE_RGB,
-                                     has_alpha,
-                                     bits_per_sample,
-                                     width,
-                                     height,
-                                     rowstride,
-                                     (GdkPixbufDestroyNotify)(GCallback)g_free,
-                                     NULL);
-
-  return (GIcon *)pixbuf;
+  pixels = g_variant_get_data_as_bytes (data_variant);
+  hash = image_data_hash (pixels, width, height, rowstride, has_alpha);
+
+  for (GList *iter = self->images.head; iter != NULL; iter = iter->next)
+    {
+      entry = iter->data;
+
+      if (entry->hash != hash ||
+          gdk_pixbuf_get_width (entry->pixbuf) != width ||
+          gdk_pixbuf_get_height (entry->pixbuf) != height ||
+          gdk_pixbuf_get_rowstride (entry->pixbuf) != rowstride ||
+          gdk_pixbuf_get_has_alpha (entry->pixbuf) != has_alpha ||
+          !g_bytes_equal (entry->pixels, pixels))
+        continue;
+
+      g_queue_unlink (&self->images, iter);
+      g_queue_push_head_link (&self->images, iter);
+
+      return g_object_ref (G_ICON (entry->pixbuf));
+    }
+
+  pixbuf = gdk_pixbuf_new_from_bytes (pixels,
+                                      GDK_COLORSPACE_RGB,
+                                      has_alpha,
+                                      bits_per_sample,
+                                      width,
+                                      height,
+                                      rowstride);
+
+  if (pixbuf == NULL)
+    {
+      g_warning ("Failed to create pixbuf from image data");
+      return NULL;
+    }
+
+  entry = g_new0 (ImageEntry, 1);
+  entry->pixbuf = g_steal_pointer (&pixbuf);
+  entry->pixels = g_steal_pointer (&pixels);
+  entry->hash = hash;
+  g_queue_push_head (&self->images, entry);
+
+  while (self->images.length > IMAGE_CACHE_SIZE)
+    image_entry_free (g_queue_pop_tail (&self->images));
+
+  return g_object_ref (G_ICON (entry->pixbuf));
 }
 
 static void
@@ -135,6 +242,7 @@ static void
 _notify (ValentNotificationsAdapter *adapter,
          GVariant                   *parameters)
 {
+  ValentFdoNotifications *self = VALENT_FDO_NOTIFICATIONS (adapter);
   g_autoptr (ValentNotification) notification = NULL;
   g_autoptr (GIcon) icon = NULL;
 
@@ -178,7 +286,7 @@ _notify (ValentNotificationsAdapter *adapter,
   if (g_variant_lookup (hints, "image-data", "@(iiibiiay)", &image_data) ||
       g_variant_lookup (hints, "image_data", "@(iiibiiay)", &image_data))
     {
-      icon = _g_icon_new_for_variant (image_data);
+      icon = _g_icon_new_for_variant (self, image_data);
       valent_notification_set_icon (notification, icon);
     }
   else if (g_variant_lookup (hints, "image-path", "&s", &image_path) ||
@@ -194,7 +302,7 @@ _notify (ValentNotificationsAdapter *adapter,
     }
   else if (g_variant_lookup (hints, "icon_data", "@(iiibiiay)", &image_data))
     {
-      icon = _g_icon_new_for_variant (image_data);
+      icon = _g_icon_new_for_variant (self, image_data);
       valent_notification_set_icon (notification, icon);
     }
 
@@ -495,6 +603,7 @@ valent_fdo_notifications_dispose (GObject *object)
 
   g_clear_object (&self->monitor);
   g_clear_object (&self->session);
+  g_queue_clear_full (&self->images, image_entry_free);
 
   G_OBJECT_CLASS (valent_fdo_notifications_parent_class)->dispose (object);
 }
@@ -527,5 +636,6 @@ valent_fdo_notifications_init (ValentFdoNotifications *self)
   self->vtable.method_call = valent_fdo_notifications_method_call;
   self->vtable.get_property = NULL;
   self->vtable.set_property = NULL;
+  g_queue_init (&self->images);
 }
 
@@ -11,6 +11,7 @@
 
 #include "valent-lan-channel.h"
 #include "valent-lan-channel-service.h"
+#include "valent-lan-transfer-pool.h"
 #include "valent-lan-utils.h"
 
 #define IDENTITY_BUFFER_MAX  (8192)
@@ -34,7 +35,15 @@ struct _ValentLanChannelService
   GMainLoop            *udp_context;
   GSocket              *udp_socket4;
   GSocket              *udp_socket6;
+  GPtrArray            *udp_queue4;
+  GPtrArray            *udp_queue6;
   GHashTable           *channels;
+
+  /* Persistent listeners for payload transfers */
+  ValentLanTransferPool *transfer_pool;
+
+  /* Serialized identity, cleared when the identity is rebuilt */
+  GBytes               *identity_bytes;
 };
 
 static void   g_async_initable_iface_init (GAsyncInitableIface *iface);
@@ -273,6 +282,7 @@ on_incoming_connection (ValentChannelService   *service,
                           "port",          self->port,
                           "identity",      identity,
                           "peer-identity", peer_identity,
+                          "transfer-pool", self->transfer_pool,
                           NULL);
 
   valent_channel_service_channel (service, channel);
@@ -453,6 +463,7 @@ incoming_broadcast_task (GTask        *task,
                           "port",          port,
                           "identity",      identity,
                           "peer-identity", peer_identity,
+                          "transfer-pool", self->transfer_pool,
                           NULL);
 
   valent_channel_service_channel (service, channel);
@@ -561,33 +572,100 @@ valent_lan_channel_service_socket_recv (GSocket      *socket,
   return G_SOURCE_CONTINUE;
 }
 
+/*
+ * Get the serialized identity, serializing it only if it was rebuilt since the
+ * last call. The caller must hold the object lock.
+ */
+static GBytes *
+valent_lan_channel_service_dup_identity_bytes (ValentLanChannelService *self)
+{
+  g_assert (VALENT_IS_LAN_CHANNEL_SERVICE (self));
+
+  if (self->identity_bytes == NULL)
+    {
+      g_autoptr (JsonNode) identity = NULL;
+      char *identity_json = NULL;
+
+      identity = valent_channel_service_ref_identity (VALENT_CHANNEL_SERVICE (self));
+
+      if (identity == NULL)
+        return NULL;
+
+      identity_json = valent_packet_serialize (identity);
+      self->identity_bytes = g_bytes_new_take (identity_json,
+                                               strlen (identity_json));
+    }
+
+  return g_bytes_ref (self->identity_bytes);
+}
+
+/*
+ * Send the identity to each address queued for @socket, with as few system
+ * calls as the platform allows (i.e. sendmmsg() on Linux).
+ */
 static gboolean
 valent_lan_channel_service_socket_send (GSocket      *socket,
                                         GIOCondition  condition,
                                         gpointer      user_data)
 {
-  GSocketAddress *address = G_SOCKET_ADDRESS (user_data);
-  GBytes *bytes = NULL;
-  gssize written;
-  g_autoptr (GError) error = NULL;
+  ValentLanChannelService *self = VALENT_LAN_CHANNEL_SERVICE (user_data);
+  g_autoptr (GPtrArray) addresses = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree GOutputMessage *messages = NULL;
+  GOutputVector vector;
+  unsigned int n_sent = 0;
 
   g_assert (G_IS_SOCKET (socket));
-  g_assert (G_IS_SOCKET_ADDRESS (address));
+  g_assert (VALENT_IS_LAN_CHANNEL_SERVICE (self));
 
-  if (condition != G_IO_OUT)
+  valent_object_lock (VALENT_OBJECT (self));
+  if (socket == self->udp_socket6)
+    {
+      addresses = g_steal_pointer (&self->udp_queue6);
+      self->udp_queue6 = g_ptr_array_new_with_free_func (g_object_unref);
+    }
+  else if (socket == self->udp_socket4)
+    {
+      addresses = g_steal_pointer (&self->udp_queue4);
+      self->udp_queue4 = g_ptr_array_new_with_free_func (g_object_unref);
+    }
+  bytes = valent_lan_channel_service_dup_identity_bytes (self);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  if (condition != G_IO_OUT || addresses == NULL || bytes == NULL)
     return G_SOURCE_REMOVE;
 
-  bytes = g_object_get_data (G_OBJECT (address), "valent-lan-broadcast");
-  written = g_socket_send_to (socket,
-                              address,
-                              g_bytes_get_data (bytes, NULL),
-                              g_bytes_get_size (bytes),
-                              NULL,
-                              &error);
+  vector.buffer = g_bytes_get_data (bytes, &vector.size);
+  messages = g_new0 (GOutputMessage, addresses->len);
 
-  /* We only check for real errors, not partial writes */
-  if (written == -1)
-    g_warning ("%s(): failed to identify: %s", G_STRFUNC, error->message);
+  for (unsigned int i = 0; i < addresses->len; i++)
+    {
+      messages[i].address = g_ptr_array_index (addresses, i);
+      messages[i].vectors = &vector;
+      messages[i].num_vectors = 1;
+    }
+
+  while (n_sent < addresses->len)
+    {
+      int ret;
+      g_autoptr (GError) error = NULL;
+
+      ret = g_socket_send_messages (socket,
+                                    &messages[n_sent],
+                                    addresses->len - n_sent,
+                                    G_SOCKET_MSG_NONE,
+                                    NULL,
+                                    &error);
+
+      /* We only check for real errors, not partial writes */
+      if (ret == -1)
+        {
+          g_warning ("%s(): failed to identify: %s", G_STRFUNC, error->message);
+          break;
+        }
+
+      n_sent += ret;
+    }
 
   return G_SOURCE_REMOVE;
 }
@@ -596,10 +674,9 @@ static void
 valent_lan_channel_service_socket_queue (ValentLanChannelService *self,
                                          GSocketAddress          *address)
 {
-  g_autoptr (JsonNode) identity = NULL;
-  g_autoptr (GBytes) identity_bytes = NULL;
-  char *identity_json = NULL;
   GSocketFamily family = G_SOCKET_FAMILY_INVALID;
+  GSocket *socket = NULL;
+  GPtrArray *queue = NULL;
 
   g_assert (VALENT_IS_LAN_CHANNEL_SERVICE (self));
   g_assert (G_IS_SOCKET_ADDRESS (address));
@@ -610,39 +687,42 @@ valent_lan_channel_service_socket_queue (ValentLanChannelService *self,
   if (family != G_SOCKET_FAMILY_IPV4 && family != G_SOCKET_FAMILY_IPV6)
     g_return_if_reached ();
 
-  /* Serialize the identity */
-  identity = valent_channel_service_ref_identity (VALENT_CHANNEL_SERVICE (self));
-  identity_json = valent_packet_serialize (identity);
-  identity_bytes = g_bytes_new_take (identity_json, strlen (identity_json));
-  g_object_set_data_full (G_OBJECT (address),
-                          "valent-lan-broadcast",
-                          g_bytes_ref (identity_bytes),
-                          (GDestroyNotify)g_bytes_unref);
-
+  /* IPv4 addresses are sent from the IPv4 socket, falling back to the IPv6
+   * socket only if it is dual-stack and there is no IPv4 socket */
   valent_object_lock (VALENT_OBJECT (self));
-  if ((self->udp_socket6 != NULL && family == G_SOCKET_FAMILY_IPV6) ||
-      (self->udp_socket6 != NULL && g_socket_speaks_ipv4 (self->udp_socket6)))
+  if (family == G_SOCKET_FAMILY_IPV6 && self->udp_socket6 != NULL)
     {
-      g_autoptr (GSource) source = NULL;
-
-      source = g_socket_create_source (self->udp_socket6, G_IO_OUT, NULL);
-      g_source_set_callback (source,
-                             G_SOURCE_FUNC (valent_lan_channel_service_socket_send),
-                             g_object_ref (address),
-                             g_object_unref);
-      g_source_attach (source, g_main_loop_get_context (self->udp_context));
+      socket = self->udp_socket6;
+      queue = self->udp_queue6;
+    }
+  else if (family == G_SOCKET_FAMILY_IPV4 && self->udp_socket4 != NULL)
+    {
+      socket = self->udp_socket4;
+      queue = self->udp_queue4;
+    }
+  else if (family == G_SOCKET_FAMILY_IPV4 && self->udp_socket6 != NULL &&
+           g_socket_speaks_ipv4 (self->udp_socket6))
+    {
+      socket = self->udp_socket6;
+      queue = self->udp_queue6;
     }
 
-  if (self->udp_socket4 != NULL && family == G_SOCKET_FAMILY_IPV4)
+  /* Addresses queued before the socket is writable are sent together */
+  if (queue != NULL)
     {
-      g_autoptr (GSource) source = NULL;
+      g_ptr_array_add (queue, g_object_ref (address));
 
-      source = g_socket_create_source (self->udp_socket4, G_IO_OUT, NULL);
-      g_source_set_callback (source,
-                             G_SOURCE_FUNC (valent_lan_channel_service_socket_send),
-                             g_object_ref (address),
-                             g_object_unref);
-      g_source_attach (source, g_main_loop_get_context (self->udp_context));
+      if (queue->len == 1)
+        {
+          g_autoptr (GSource) source = NULL;
+
+          source = g_socket_create_source (socket, G_IO_OUT, NULL);
+          g_source_set_callback (source,
+                                 G_SOURCE_FUNC (valent_lan_channel_service_socket_send),
+                                 g_object_ref (self),
+                                 g_object_unref);
+          g_source_attach (source, g_main_loop_get_context (self->udp_context));
+        }
     }
   valent_object_unlock (VALENT_OBJECT (self));
 }
@@ -827,6 +907,11 @@ valent_lan_channel_service_build_identity (ValentChannelService *service)
       body = valent_packet_get_body (identity);
       json_object_set_int_member (body, "tcpPort", self->tcp_port);
     }
+
+  /* Drop the serialized identity, so the next broadcast picks up the change */
+  valent_object_lock (VALENT_OBJECT (self));
+  g_clear_pointer (&self->identity_bytes, g_bytes_unref);
+  valent_object_unlock (VALENT_OBJECT (self));
 }
 
 static void
@@ -911,6 +996,13 @@ valent_lan_channel_service_init_task (GTask        *task,
   if (g_task_return_error_if_cancelled (task))
     return;
 
+  /* Transfer ports are bound on demand and reused while uploads are active,
+   * so the pool must exist before any channels are accepted */
+  valent_object_lock (VALENT_OBJECT (self));
+  if (self->certificate != NULL)
+    self->transfer_pool = valent_lan_transfer_pool_new (self->certificate);
+  valent_object_unlock (VALENT_OBJECT (self));
+
   if (!valent_lan_channel_service_tcp_setup (self, cancellable, &error) ||
       !valent_lan_channel_service_udp_setup (self, cancellable, &error))
     return g_task_return_error (task, g_steal_pointer (&error));
@@ -1012,6 +1104,9 @@ valent_lan_channel_service_dispose (GObject *object)
       g_socket_listener_close (G_SOCKET_LISTENER (self->listener));
       g_clear_object (&self->listener);
     }
+
+  if (self->transfer_pool != NULL)
+    valent_lan_transfer_pool_close (self->transfer_pool);
   valent_object_unlock (VALENT_OBJECT (self));
 
   G_OBJECT_CLASS (valent_lan_channel_service_parent_class)->dispose (object);
@@ -1023,8 +1118,12 @@ valent_lan_channel_service_finalize (GObject *object)
   ValentLanChannelService *self = VALENT_LAN_CHANNEL_SERVICE (object);
 
   g_clear_object (&self->certificate);
+  g_clear_object (&self->transfer_pool);
   g_clear_pointer (&self->broadcast_address, g_free);
   g_clear_pointer (&self->channels, g_hash_table_unref);
+  g_clear_pointer (&self->udp_queue4, g_ptr_array_unref);
+  g_clear_pointer (&self->udp_queue6, g_ptr_array_unref);
+  g_clear_pointer (&self->identity_bytes, g_bytes_unref);
 
   G_OBJECT_CLASS (valent_lan_channel_service_parent_class)->finalize (object);
 }
@@ -1149,6 +1248,8 @@ valent_lan_channel_service_init (ValentLanChannelService *self)
                                           g_str_equal,
                                           g_free,
                                           NULL);
+  self->udp_queue4 = g_ptr_array_new_with_free_func (g_object_unref);
+  self->udp_queue6 = g_ptr_array_new_with_free_func (g_object_unref);
   self->monitor = g_network_monitor_get_default ();
 }
 
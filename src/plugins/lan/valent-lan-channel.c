@@ -11,6 +11,7 @@
 #include <valent.h>
 
 #include "valent-lan-channel.h"
+#include "valent-lan-transfer-pool.h"
 #include "valent-lan-utils.h"
 
 
@@ -18,9 +19,14 @@ struct _ValentLanChannel
 {
   ValentChannel    parent_instance;
 
-  char            *verification_key;
-  char            *host;
-  uint16_t         port;
+  char                  *verification_key;
+  char                  *host;
+  uint16_t               port;
+  ValentLanTransferPool *transfer_pool;
+
+  /* The last download and a copy of its session state, for resumption */
+  GWeakRef               download;
+  GIOStream             *session;
 };
 
 G_DEFINE_FINAL_TYPE (ValentLanChannel, valent_lan_channel, VALENT_TYPE_CHANNEL)
@@ -31,6 +37,7 @@ enum {
   PROP_HOST,
   PROP_PEER_CERTIFICATE,
   PROP_PORT,
+  PROP_TRANSFER_POOL,
   N_PROPERTIES
 };
 
@@ -81,6 +88,69 @@ valent_lan_channel_get_verification_key (ValentChannel *channel)
   return self->verification_key;
 }
 
+/*
+ * Copy the session state of @tls_stream into a client connection that is never
+ * used for I/O, so the session can be resumed without keeping the transfer's
+ * socket open.
+ */
+static GIOStream *
+valent_lan_channel_save_session (GIOStream *tls_stream)
+{
+  g_autoptr (GInputStream) input = NULL;
+  g_autoptr (GOutputStream) output = NULL;
+  g_autoptr (GIOStream) base_stream = NULL;
+  GIOStream *ret = NULL;
+
+  g_assert (G_IS_TLS_CLIENT_CONNECTION (tls_stream));
+
+  input = g_memory_input_stream_new ();
+  output = g_memory_output_stream_new_resizable ();
+  base_stream = g_simple_io_stream_new (input, output);
+  ret = g_tls_client_connection_new (base_stream, NULL, NULL);
+
+  if (ret != NULL)
+    g_tls_client_connection_copy_session_state (G_TLS_CLIENT_CONNECTION (ret),
+                                                G_TLS_CLIENT_CONNECTION (tls_stream));
+
+  return ret;
+}
+
+/*
+ * Get a client connection to resume a TLS session from, preferring the last
+ * successful download and falling back to the base stream.
+ *
+ * Session tickets may arrive after the handshake, so the session state is
+ * refreshed from the last download while it is still open.
+ */
+static GIOStream *
+valent_lan_channel_ref_session (ValentLanChannel *self)
+{
+  g_autoptr (GIOStream) base_stream = NULL;
+  g_autoptr (GIOStream) download = NULL;
+  GIOStream *ret = NULL;
+
+  valent_object_lock (VALENT_OBJECT (self));
+  if ((download = g_weak_ref_get (&self->download)) != NULL)
+    {
+      g_clear_object (&self->session);
+      self->session = valent_lan_channel_save_session (download);
+    }
+
+  if (self->session != NULL)
+    ret = g_object_ref (self->session);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  if (ret == NULL)
+    {
+      base_stream = valent_channel_ref_base_stream (VALENT_CHANNEL (self));
+
+      if (G_IS_TLS_CLIENT_CONNECTION (base_stream))
+        ret = g_steal_pointer (&base_stream);
+    }
+
+  return ret;
+}
+
 static GIOStream *
 valent_lan_channel_download (ValentChannel  *channel,
                              JsonNode       *packet,
@@ -96,6 +166,7 @@ valent_lan_channel_download (ValentChannel  *channel,
   g_autoptr (GTlsCertificate) certificate = NULL;
   g_autoptr (GTlsCertificate) peer_certificate = NULL;
   g_autofree char *host = NULL;
+  g_autoptr (GIOStream) session = NULL;
   g_autoptr (GIOStream) tls_stream = NULL;
 
   g_assert (VALENT_IS_CHANNEL (channel));
@@ -136,9 +207,11 @@ valent_lan_channel_download (ValentChannel  *channel,
   /* We're the TLS client when downloading */
   certificate = valent_lan_channel_ref_certificate (self);
   peer_certificate = valent_lan_channel_ref_peer_certificate (self);
+  session = valent_lan_channel_ref_session (self);
   tls_stream = valent_lan_encrypt_client (connection,
                                           certificate,
                                           peer_certificate,
+                                          session,
                                           cancellable,
                                           error);
 
@@ -148,6 +221,14 @@ valent_lan_channel_download (ValentChannel  *channel,
       return NULL;
     }
 
+  g_clear_object (&session);
+  session = valent_lan_channel_save_session (tls_stream);
+
+  valent_object_lock (VALENT_OBJECT (self));
+  g_weak_ref_set (&self->download, tls_stream);
+  g_set_object (&self->session, session);
+  valent_object_unlock (VALENT_OBJECT (self));
+
   return g_steal_pointer (&tls_stream);
 }
 
@@ -171,6 +252,28 @@ valent_lan_channel_upload (ValentChannel  *channel,
   g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
   g_assert (error == NULL || *error == NULL);
 
+  /* Prefer the service's persistent listeners, if available */
+  if (self->transfer_pool != NULL)
+    {
+      peer_certificate = valent_lan_channel_ref_peer_certificate (self);
+
+      if (peer_certificate == NULL)
+        {
+          g_set_error_literal (error,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_CONNECTED,
+                               "Channel is not connected");
+          return NULL;
+        }
+
+      return valent_lan_transfer_pool_accept (self->transfer_pool,
+                                              channel,
+                                              packet,
+                                              peer_certificate,
+                                              cancellable,
+                                              error);
+    }
+
   /* Find an open port */
   listener = g_socket_listener_new ();
 
@@ -262,6 +365,9 @@ valent_lan_channel_finalize (GObject *object)
 
   g_clear_pointer (&self->host, g_free);
   g_clear_pointer (&self->verification_key, g_free);
+  g_clear_object (&self->transfer_pool);
+  g_weak_ref_clear (&self->download);
+  g_clear_object (&self->session);
 
   G_OBJECT_CLASS (valent_lan_channel_parent_class)->finalize (object);
 }
@@ -319,6 +425,10 @@ valent_lan_channel_set_property (GObject      *object,
       valent_object_unlock (VALENT_OBJECT (self));
       break;
 
+    case PROP_TRANSFER_POOL:
+      self->transfer_pool = g_value_dup_object (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -390,12 +500,28 @@ valent_lan_channel_class_init (ValentLanChannelClass *klass)
                         G_PARAM_EXPLICIT_NOTIFY |
                         G_PARAM_STATIC_STRINGS));
 
+  /**
+   * ValentLanChannel:transfer-pool: (skip)
+   *
+   * The pool of listening ports used for uploads.
+   *
+   * If %NULL, a listener will be opened for each upload.
+   */
+  properties [PROP_TRANSFER_POOL] =
+    g_param_spec_object ("transfer-pool", NULL, NULL,
+                         VALENT_TYPE_LAN_TRANSFER_POOL,
+                         (G_PARAM_WRITABLE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
 static void
 valent_lan_channel_init (ValentLanChannel *self)
 {
+  g_weak_ref_init (&self->download, NULL);
 }
 
 /**
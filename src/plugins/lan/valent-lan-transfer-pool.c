@@ -0,0 +1,565 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-lan-transfer-pool"
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+#include <valent.h>
+
+#include "valent-lan-transfer-pool.h"
+#include "valent-lan-utils.h"
+
+#define TRANSFER_TIMEOUT_MAX        (10000)
+#define TRANSFER_ACCEPT_TIMEOUT_MAX (30 * G_TIME_SPAN_SECOND)
+#define TRANSFER_PORT_IDLE_TIMEOUT  (30)
+
+
+/**
+ * ValentLanTransferPool:
+ *
+ * A pool of persistent listening ports for payload transfers.
+ *
+ * Rather than binding a new listener for every upload, the pool keeps a small
+ * set of ports from the KDE Connect transfer range open while uploads are
+ * active. Each pending upload reserves a port, and incoming connections are
+ * matched to it by the port and the TLS certificate the peer presents during
+ * the handshake.
+ *
+ * A port may be shared by uploads to different devices, but only one upload
+ * per device may be pending on a given port. New ports are bound only when
+ * every open port is already reserved for that device, and ports without a
+ * pending upload are closed after a short idle period.
+ */
+
+typedef struct
+{
+  uint16_t         port;
+  GTlsCertificate *peer_certificate;
+  GIOStream       *stream;
+} TransferRequest;
+
+typedef struct
+{
+  uint16_t         port;
+  GSocketService  *service;
+  unsigned int     n_requests;
+  int64_t          idle_since;
+} TransferPort;
+
+struct _ValentLanTransferPool
+{
+  GObject          parent_instance;
+
+  GMutex           mutex;
+  GCond            cond;
+  GTlsCertificate *certificate;
+  GPtrArray       *ports;
+  GPtrArray       *requests;
+  GSource         *idle_source;
+  gboolean         closed;
+};
+
+G_DEFINE_FINAL_TYPE (ValentLanTransferPool, valent_lan_transfer_pool, G_TYPE_OBJECT)
+
+
+static gboolean
+transfer_timeout_cb (gpointer data)
+{
+  g_assert (G_IS_CANCELLABLE (data));
+
+  g_cancellable_cancel ((GCancellable *)data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_run (GThreadedSocketService *service,
+        GSocketConnection      *connection,
+        GObject                *source_object,
+        ValentLanTransferPool  *self)
+{
+  g_autoptr (GSocketAddress) address = NULL;
+  g_autoptr (GPtrArray) trusted = NULL;
+  g_autoptr (GCancellable) timeout = NULL;
+  g_autoptr (GSource) timeout_source = NULL;
+  g_autoptr (GIOStream) tls_stream = NULL;
+  g_autoptr (GError) error = NULL;
+  GTlsCertificate *peer_certificate;
+  uint16_t port;
+
+  g_assert (VALENT_IS_LAN_TRANSFER_POOL (self));
+
+  address = g_socket_connection_get_local_address (connection, &error);
+
+  if (address == NULL)
+    {
+      g_debug ("%s(): %s", G_STRFUNC, error->message);
+      return TRUE;
+    }
+
+  port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address));
+
+  /* Collect the peers expected on this port */
+  trusted = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_mutex_lock (&self->mutex);
+  for (unsigned int i = 0; i < self->requests->len; i++)
+    {
+      TransferRequest *request = g_ptr_array_index (self->requests, i);
+
+      if (request->port == port && request->stream == NULL)
+        g_ptr_array_add (trusted, g_object_ref (request->peer_certificate));
+    }
+  g_mutex_unlock (&self->mutex);
+
+  if (trusted->len == 0)
+    {
+      g_debug ("%s(): unexpected connection on port %u", G_STRFUNC, port);
+      return TRUE;
+    }
+
+  /* Timeout if the peer fails to authenticate in a timely fashion */
+  timeout = g_cancellable_new ();
+  timeout_source = g_timeout_source_new (TRANSFER_TIMEOUT_MAX);
+  g_source_set_callback (timeout_source,
+                         transfer_timeout_cb,
+                         g_object_ref (timeout),
+                         g_object_unref);
+  g_source_attach (timeout_source, NULL);
+
+  /* We're the TLS server when uploading */
+  tls_stream = valent_lan_encrypt_server_any (connection,
+                                              self->certificate,
+                                              trusted,
+                                              timeout,
+                                              &error);
+  g_source_destroy (timeout_source);
+
+  if (tls_stream == NULL)
+    {
+      g_debug ("%s(): %s", G_STRFUNC, error->message);
+      return TRUE;
+    }
+
+  /* Hand the stream to the upload waiting for this peer */
+  peer_certificate = g_tls_connection_get_peer_certificate (G_TLS_CONNECTION (tls_stream));
+
+  g_mutex_lock (&self->mutex);
+  for (unsigned int i = 0; i < self->requests->len; i++)
+    {
+      TransferRequest *request = g_ptr_array_index (self->requests, i);
+
+      if (request->port == port && request->stream == NULL &&
+          g_tls_certificate_is_same (request->peer_certificate, peer_certificate))
+        {
+          request->stream = g_steal_pointer (&tls_stream);
+          g_cond_broadcast (&self->cond);
+          break;
+        }
+    }
+  g_mutex_unlock (&self->mutex);
+
+  /* The upload was cancelled during the handshake */
+  if (tls_stream != NULL)
+    g_io_stream_close (tls_stream, NULL, NULL);
+
+  return TRUE;
+}
+
+static void
+on_cancelled (GCancellable          *cancellable,
+              ValentLanTransferPool *self)
+{
+  g_mutex_lock (&self->mutex);
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->mutex);
+}
+
+static void
+transfer_port_free (gpointer data)
+{
+  TransferPort *port = data;
+
+  g_socket_service_stop (port->service);
+  g_socket_listener_close (G_SOCKET_LISTENER (port->service));
+  g_clear_object (&port->service);
+  g_free (port);
+}
+
+/*
+ * Close the ports that have been without a pending upload for the idle period.
+ * The source is removed once no idle ports remain.
+ */
+static gboolean
+transfer_idle_cb (gpointer data)
+{
+  ValentLanTransferPool *self = VALENT_LAN_TRANSFER_POOL (data);
+  int64_t now = g_get_monotonic_time ();
+  gboolean idle = FALSE;
+
+  g_mutex_lock (&self->mutex);
+  for (unsigned int i = 0; i < self->ports->len; i++)
+    {
+      TransferPort *port = g_ptr_array_index (self->ports, i);
+
+      if (port->n_requests > 0)
+        continue;
+
+      if (now - port->idle_since >= TRANSFER_PORT_IDLE_TIMEOUT * G_TIME_SPAN_SECOND)
+        {
+          VALENT_NOTE ("closing idle transfer port %u", port->port);
+          g_ptr_array_remove_index_fast (self->ports, i--);
+        }
+      else
+        {
+          idle = TRUE;
+        }
+    }
+
+  if (!idle)
+    g_clear_pointer (&self->idle_source, g_source_unref);
+  g_mutex_unlock (&self->mutex);
+
+  return idle ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/*
+ * Bind a listener for @port. Each port has its own service, so that it can be
+ * closed independently once it is idle. Called with the lock held.
+ */
+static TransferPort *
+valent_lan_transfer_pool_bind (ValentLanTransferPool *self,
+                               uint16_t               port)
+{
+  g_autoptr (GSocketService) service = NULL;
+  TransferPort *ret;
+
+  service = g_threaded_socket_service_new (g_get_num_processors ());
+
+  if (!g_socket_listener_add_inet_port (G_SOCKET_LISTENER (service),
+                                        port,
+                                        NULL,
+                                        NULL))
+    return NULL;
+
+  g_signal_connect_object (service,
+                           "run",
+                           G_CALLBACK (on_run),
+                           self,
+                           0);
+
+  ret = g_new0 (TransferPort, 1);
+  ret->port = port;
+  ret->service = g_steal_pointer (&service);
+  g_ptr_array_add (self->ports, ret);
+
+  return ret;
+}
+
+/*
+ * Reserve a port for @request, binding a new one only if every open port
+ * already has a pending upload for the same peer. Called with the lock held.
+ */
+static gboolean
+valent_lan_transfer_pool_reserve (ValentLanTransferPool  *self,
+                                  TransferRequest        *request,
+                                  GError                **error)
+{
+  for (unsigned int i = 0; i < self->ports->len; i++)
+    {
+      TransferPort *port = g_ptr_array_index (self->ports, i);
+      gboolean reserved = FALSE;
+
+      for (unsigned int j = 0; j < self->requests->len; j++)
+        {
+          TransferRequest *pending = g_ptr_array_index (self->requests, j);
+
+          if (pending->port == port->port &&
+              g_tls_certificate_is_same (pending->peer_certificate,
+                                         request->peer_certificate))
+            {
+              reserved = TRUE;
+              break;
+            }
+        }
+
+      if (!reserved)
+        {
+          port->n_requests += 1;
+          request->port = port->port;
+          return TRUE;
+        }
+    }
+
+  for (uint16_t port = VALENT_LAN_TRANSFER_PORT_MIN;
+       port <= VALENT_LAN_TRANSFER_PORT_MAX;
+       port++)
+    {
+      TransferPort *transfer_port;
+      gboolean bound = FALSE;
+
+      for (unsigned int i = 0; i < self->ports->len; i++)
+        {
+          transfer_port = g_ptr_array_index (self->ports, i);
+
+          if ((bound = (transfer_port->port == port)))
+            break;
+        }
+
+      if (bound)
+        continue;
+
+      if ((transfer_port = valent_lan_transfer_pool_bind (self, port)) != NULL)
+        {
+          transfer_port->n_requests += 1;
+          request->port = port;
+          return TRUE;
+        }
+    }
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_ADDRESS_IN_USE,
+               "No transfer port available between %u-%u",
+               VALENT_LAN_TRANSFER_PORT_MIN,
+               VALENT_LAN_TRANSFER_PORT_MAX);
+  return FALSE;
+}
+
+/*
+ * Release the port reserved for @request, scheduling it to be closed if it has
+ * no other pending uploads. Called with the lock held.
+ */
+static void
+valent_lan_transfer_pool_release (ValentLanTransferPool *self,
+                                  TransferRequest       *request)
+{
+  for (unsigned int i = 0; i < self->ports->len; i++)
+    {
+      TransferPort *port = g_ptr_array_index (self->ports, i);
+
+      if (port->port != request->port)
+        continue;
+
+      if (--port->n_requests == 0)
+        {
+          port->idle_since = g_get_monotonic_time ();
+
+          if (self->idle_source == NULL && !self->closed)
+            {
+              self->idle_source = g_timeout_source_new_seconds (TRANSFER_PORT_IDLE_TIMEOUT);
+              g_source_set_callback (self->idle_source,
+                                     transfer_idle_cb,
+                                     g_object_ref (self),
+                                     g_object_unref);
+              g_source_attach (self->idle_source, NULL);
+            }
+        }
+      break;
+    }
+}
+
+/*
+ * GObject
+ */
+static void
+valent_lan_transfer_pool_finalize (GObject *object)
+{
+  ValentLanTransferPool *self = VALENT_LAN_TRANSFER_POOL (object);
+
+  valent_lan_transfer_pool_close (self);
+
+  g_clear_object (&self->certificate);
+  g_clear_pointer (&self->ports, g_ptr_array_unref);
+  g_clear_pointer (&self->requests, g_ptr_array_unref);
+  g_mutex_clear (&self->mutex);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (valent_lan_transfer_pool_parent_class)->finalize (object);
+}
+
+static void
+valent_lan_transfer_pool_class_init (ValentLanTransferPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = valent_lan_transfer_pool_finalize;
+}
+
+static void
+valent_lan_transfer_pool_init (ValentLanTransferPool *self)
+{
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+  self->ports = g_ptr_array_new_with_free_func (transfer_port_free);
+  self->requests = g_ptr_array_new ();
+}
+
+/**
+ * valent_lan_transfer_pool_new:
+ * @certificate: a #GTlsCertificate
+ *
+ * Create a new transfer pool, authenticating as @certificate.
+ *
+ * Returns: (transfer full): a new #ValentLanTransferPool
+ */
+ValentLanTransferPool *
+valent_lan_transfer_pool_new (GTlsCertificate *certificate)
+{
+  ValentLanTransferPool *self;
+
+  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
+
+  self = g_object_new (VALENT_TYPE_LAN_TRANSFER_POOL, NULL);
+  self->certificate = g_object_ref (certificate);
+
+  return self;
+}
+
+/**
+ * valent_lan_transfer_pool_accept:
+ * @pool: a #ValentLanTransferPool
+ * @channel: a #ValentChannel
+ * @packet: a KDE Connect packet
+ * @peer_certificate: the #GTlsCertificate of the receiving device
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): a #GError
+ *
+ * Reserve a port for @packet, send it over @channel and wait for the device
+ * presenting @peer_certificate to connect.
+ *
+ * This function blocks until the connection is authenticated, the pool is
+ * closed, @cancellable is triggered or the device fails to connect in a timely
+ * fashion.
+ *
+ * Returns: (transfer full) (nullable): a TLS encrypted #GIOStream
+ */
+GIOStream *
+valent_lan_transfer_pool_accept (ValentLanTransferPool  *pool,
+                                 ValentChannel          *channel,
+                                 JsonNode               *packet,
+                                 GTlsCertificate        *peer_certificate,
+                                 GCancellable           *cancellable,
+                                 GError                **error)
+{
+  TransferRequest request = { 0, peer_certificate, NULL };
+  JsonObject *info;
+  unsigned long cancellable_id = 0;
+  int64_t end_time;
+  GIOStream *ret = NULL;
+
+  g_return_val_if_fail (VALENT_IS_LAN_TRANSFER_POOL (pool), NULL);
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), NULL);
+  g_return_val_if_fail (VALENT_IS_PACKET (packet), NULL);
+  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (peer_certificate), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  g_mutex_lock (&pool->mutex);
+  if (pool->closed)
+    {
+      g_mutex_unlock (&pool->mutex);
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CLOSED,
+                           "Transfer pool is closed");
+      return NULL;
+    }
+
+  if (!valent_lan_transfer_pool_reserve (pool, &request, error))
+    {
+      g_mutex_unlock (&pool->mutex);
+      return NULL;
+    }
+
+  g_ptr_array_add (pool->requests, &request);
+  g_mutex_unlock (&pool->mutex);
+
+  /* Set the payload information and notify the device */
+  info = json_object_new ();
+  json_object_set_int_member (info, "port", (int64_t)request.port);
+  valent_packet_set_payload_info (packet, info);
+
+  valent_channel_write_packet (channel, packet, cancellable, NULL, NULL);
+
+  /* Wait for the device to connect */
+  if (cancellable != NULL)
+    cancellable_id = g_cancellable_connect (cancellable,
+                                            G_CALLBACK (on_cancelled),
+                                            pool,
+                                            NULL);
+
+  end_time = g_get_monotonic_time () + TRANSFER_ACCEPT_TIMEOUT_MAX;
+
+  g_mutex_lock (&pool->mutex);
+  while (request.stream == NULL &&
+         !pool->closed &&
+         !g_cancellable_is_cancelled (cancellable))
+    {
+      if (!g_cond_wait_until (&pool->cond, &pool->mutex, end_time))
+        break;
+    }
+
+  g_ptr_array_remove_fast (pool->requests, &request);
+  valent_lan_transfer_pool_release (pool, &request);
+  ret = g_steal_pointer (&request.stream);
+  g_mutex_unlock (&pool->mutex);
+
+  g_cancellable_disconnect (cancellable, cancellable_id);
+
+  if (ret != NULL || g_cancellable_set_error_if_cancelled (cancellable, error))
+    return ret;
+
+  if (pool->closed)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CLOSED,
+                           "Transfer pool is closed");
+    }
+  else
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_TIMED_OUT,
+                           "Timed out waiting for the device to connect");
+    }
+
+  return ret;
+}
+
+/**
+ * valent_lan_transfer_pool_close:
+ * @pool: a #ValentLanTransferPool
+ *
+ * Close all listening ports and wake any pending uploads.
+ */
+void
+valent_lan_transfer_pool_close (ValentLanTransferPool *pool)
+{
+  g_autoptr (GPtrArray) ports = NULL;
+  g_autoptr (GSource) idle_source = NULL;
+
+  g_return_if_fail (VALENT_IS_LAN_TRANSFER_POOL (pool));
+
+  g_mutex_lock (&pool->mutex);
+  if (pool->closed)
+    {
+      g_mutex_unlock (&pool->mutex);
+      return;
+    }
+
+  pool->closed = TRUE;
+  ports = g_steal_pointer (&pool->ports);
+  pool->ports = g_ptr_array_new_with_free_func (transfer_port_free);
+  idle_source = g_steal_pointer (&pool->idle_source);
+  g_cond_broadcast (&pool->cond);
+  g_mutex_unlock (&pool->mutex);
+
+  /* Destroying the source drops its reference on the pool */
+  if (idle_source != NULL)
+    g_source_destroy (idle_source);
+}
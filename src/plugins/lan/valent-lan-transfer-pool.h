@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <valent.h>
+
+G_BEGIN_DECLS
+
+#define VALENT_TYPE_LAN_TRANSFER_POOL (valent_lan_transfer_pool_get_type())
+
+G_DECLARE_FINAL_TYPE (ValentLanTransferPool, valent_lan_transfer_pool, VALENT, LAN_TRANSFER_POOL, GObject)
+
+ValentLanTransferPool * valent_lan_transfer_pool_new    (GTlsCertificate        *certificate);
+GIOStream             * valent_lan_transfer_pool_accept (ValentLanTransferPool  *pool,
+                                                         ValentChannel          *channel,
+                                                         JsonNode               *packet,
+                                                         GTlsCertificate        *peer_certificate,
+                                                         GCancellable           *cancellable,
+                                                         GError                **error);
+void                    valent_lan_transfer_pool_close  (ValentLanTransferPool  *pool);
+
+G_END_DECLS
@@ -129,6 +129,47 @@ valent_lan_handshake_certificate (GTlsConnection   *connection,
   return TRUE;
 }
 
+/* < private >
+ * valent_lan_handshake_any:
+ * @connection: a #GTlsConnection
+ * @trusted: (element-type Gio.TlsCertificate): a list of #GTlsCertificate
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): a #GError
+ *
+ * Authenticate a connection against a set of known peers.
+ *
+ * This function is like [func@Valent.lan_handshake_certificate], except the
+ * peer may present any one of the certificates in @trusted. This should be used
+ * to authenticate auxiliary connections accepted on a shared port.
+ *
+ * Returns: %TRUE, or %FALSE with @error set
+ */
+static gboolean
+valent_lan_handshake_any (GTlsConnection   *connection,
+                          GPtrArray        *trusted,
+                          GCancellable     *cancellable,
+                          GError          **error)
+{
+  GTlsCertificate *peer_cert;
+
+  if (!valent_lan_accept_certificate (connection, cancellable, error))
+    return FALSE;
+
+  peer_cert = g_tls_connection_get_peer_certificate (connection);
+
+  for (unsigned int i = 0; i < trusted->len; i++)
+    {
+      if (g_tls_certificate_is_same (g_ptr_array_index (trusted, i), peer_cert))
+        return TRUE;
+    }
+
+  g_set_error (error,
+               G_TLS_ERROR,
+               G_TLS_ERROR_HANDSHAKE,
+               "Invalid certificate");
+  return FALSE;
+}
+
 /* < private >
  * valent_lan_handshake_peer:
  * @connection: a #GTlsConnection
@@ -258,6 +299,7 @@ valent_lan_encrypt_client_connection (GSocketConnection  *connection,
  * @connection: a #GSocketConnection
  * @certificate: a #GTlsCertificate
  * @peer_certificate: a #GTlsCertificate
+ * @session: (nullable): a #GTlsClientConnection
  * @cancellable: (nullable): a #GCancellable
  * @error: (nullable): a #GError
  *
@@ -266,12 +308,17 @@ valent_lan_encrypt_client_connection (GSocketConnection  *connection,
  * This function sets the standard KDE Connect socket options on @connection,
  * wraps it in a [class@Gio.TlsConnection] and returns the result.
  *
+ * If @session is given, its session state is offered to the server so the
+ * handshake may be resumed. If the server declines, a full handshake is
+ * performed as usual.
+ *
  * Returns: (transfer full) (nullable): a TLS encrypted #GIOStream
  */
 GIOStream *
 valent_lan_encrypt_client (GSocketConnection  *connection,
                            GTlsCertificate    *certificate,
                            GTlsCertificate    *peer_certificate,
+                           GIOStream          *session,
                            GCancellable       *cancellable,
                            GError            **error)
 {
@@ -281,6 +328,7 @@ valent_lan_encrypt_client (GSocketConnection  *connection,
   g_assert (G_IS_SOCKET_CONNECTION (connection));
   g_assert (G_IS_TLS_CERTIFICATE (certificate));
   //g_assert (G_IS_TLS_CERTIFICATE (peer_certificate));
+  g_assert (session == NULL || G_IS_TLS_CLIENT_CONNECTION (session));
   g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
   g_assert (error == NULL || *error == NULL);
 
@@ -313,6 +361,12 @@ valent_lan_encrypt_client (GSocketConnection  *connection,
 
   g_tls_connection_set_certificate (G_TLS_CONNECTION (tls_stream), certificate);
 
+  /* The server identity includes the port, which differs for each transfer,
+   * so the session state must be copied explicitly to be resumed */
+  if (session != NULL)
+    g_tls_client_connection_copy_session_state (G_TLS_CLIENT_CONNECTION (tls_stream),
+                                                G_TLS_CLIENT_CONNECTION (session));
+
   if (!valent_lan_handshake_certificate (G_TLS_CONNECTION (tls_stream),
                                          peer_certificate,
                                          cancellable,
@@ -437,3 +491,60 @@ valent_lan_encrypt_server (GSocketConnection  *connection,
   return g_steal_pointer (&tls_stream);
 }
 
+/**
+ * valent_lan_encrypt_server_any:
+ * @connection: a #GSocketConnection
+ * @certificate: a #GTlsCertificate
+ * @peer_certificates: (element-type Gio.TlsCertificate): a list of #GTlsCertificate
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): a #GError
+ *
+ * Authenticate and encrypt an auxiliary server connection from one of several
+ * known peers.
+ *
+ * This function is like [func@Valent.lan_encrypt_server], except the peer may
+ * present any certificate in @peer_certificates. Callers can use
+ * [method@Gio.TlsConnection.get_peer_certificate] on the result to find which.
+ *
+ * Returns: (transfer full) (nullable): a TLS encrypted #GIOStream
+ */
+GIOStream *
+valent_lan_encrypt_server_any (GSocketConnection  *connection,
+                               GTlsCertificate    *certificate,
+                               GPtrArray          *peer_certificates,
+                               GCancellable       *cancellable,
+                               GError            **error)
+{
+  g_autoptr (GIOStream) tls_stream = NULL;
+
+  g_assert (G_IS_SOCKET_CONNECTION (connection));
+  g_assert (G_IS_TLS_CERTIFICATE (certificate));
+  g_assert (peer_certificates != NULL);
+  g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+  g_assert (error == NULL || *error == NULL);
+
+  valent_lan_configure_socket (connection);
+
+  /* We're the server when accepting auxiliary connections */
+  tls_stream = g_tls_server_connection_new (G_IO_STREAM (connection),
+                                            certificate,
+                                            error);
+
+  if (tls_stream == NULL)
+    return NULL;
+
+  g_object_set (G_TLS_SERVER_CONNECTION (tls_stream),
+                "authentication-mode", G_TLS_AUTHENTICATION_REQUIRED,
+                NULL);
+
+  if (!valent_lan_handshake_any (G_TLS_CONNECTION (tls_stream),
+                                 peer_certificates,
+                                 cancellable,
+                                 error))
+    {
+      g_io_stream_close (tls_stream, NULL, NULL);
+      return NULL;
+    }
+
+  return g_steal_pointer (&tls_stream);
+}
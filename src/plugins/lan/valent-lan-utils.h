@@ -56,6 +56,7 @@ G_BEGIN_DECLS
 GIOStream * valent_lan_encrypt_client            (GSocketConnection  *connection,
                                                   GTlsCertificate    *certificate,
                                                   GTlsCertificate    *peer_cert,
+                                                  GIOStream          *session,
                                                   GCancellable       *cancellable,
                                                   GError            **error);
 GIOStream * valent_lan_encrypt_client_connection (GSocketConnection  *connection,
@@ -71,6 +72,11 @@ GIOStream * valent_lan_encrypt_server_connection (GSocketConnection  *connection
                                                   GTlsCertificate    *certificate,
                                                   GCancellable       *cancellable,
                                                   GError            **error);
+GIOStream * valent_lan_encrypt_server_any        (GSocketConnection  *connection,
+                                                  GTlsCertificate    *certificate,
+                                                  GPtrArray          *peer_certificates,
+                                                  GCancellable       *cancellable,
+                                                  GError            **error);
 
 G_END_DECLS
 
@@ -14,6 +14,9 @@
 
 #define DEFAULT_ICON_SIZE 512
 
+/* The maximum number of encoded icons kept in the cache */
+#define ICON_CACHE_SIZE 32
+
 
 /**
  * ValentNotificationUpload:
@@ -153,6 +156,42 @@ on_size_prepared (GdkPixbufLoader *loader,
   gdk_pixbuf_loader_set_size (loader, DEFAULT_ICON_SIZE, DEFAULT_ICON_SIZE);
 }
 
+static GBytes *
+valent_notification_upload_get_pixbuf_bytes (GdkPixbuf  *pixbuf,
+                                             GError    **error)
+{
+  g_autoptr (GdkPixbuf) scaled = NULL;
+  int width, height;
+  char *data;
+  size_t size;
+
+  g_assert (GDK_IS_PIXBUF (pixbuf));
+  g_assert (error == NULL || *error == NULL);
+
+  /* Downscale large images (e.g. screenshots), preserving the aspect ratio */
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  if (width > DEFAULT_ICON_SIZE || height > DEFAULT_ICON_SIZE)
+    {
+      double scale = MIN ((double)DEFAULT_ICON_SIZE / width,
+                          (double)DEFAULT_ICON_SIZE / height);
+
+      scaled = gdk_pixbuf_scale_simple (pixbuf,
+                                        MAX (1, (int)(width * scale)),
+                                        MAX (1, (int)(height * scale)),
+                                        GDK_INTERP_BILINEAR);
+
+      if (scaled != NULL)
+        pixbuf = scaled;
+    }
+
+  if (!gdk_pixbuf_save_to_buffer (pixbuf, &data, &size, "png", error, NULL))
+    return NULL;
+
+  return g_bytes_new_take (data, size);
+}
+
 static GBytes *
 valent_notification_upload_get_icon_bytes (GIcon         *icon,
                                            GCancellable  *cancellable,
@@ -213,7 +252,9 @@ valent_notification_upload_get_icon_bytes (GIcon         *icon,
     }
   else if (GDK_IS_PIXBUF (icon))
     {
-      bytes = gdk_pixbuf_read_pixel_bytes (GDK_PIXBUF (icon));
+      /* Raw pixel data can't be loaded, so encode the pixbuf directly */
+      return valent_notification_upload_get_pixbuf_bytes (GDK_PIXBUF (icon),
+                                                          error);
     }
 
   if (bytes == NULL)
@@ -249,6 +290,135 @@ valent_notification_upload_get_icon_bytes (GIcon         *icon,
   return g_bytes_new_take (data, size);
 }
 
+/*
+ * Icon Cache
+ *
+ * Encoded icons are kept in a least-recently-used cache shared by all devices,
+ * along with the payload hash. File icons are invalidated by their
+ * modification time.
+ */
+typedef struct
+{
+  GIcon      *icon;
+  uint64_t    mtime;
+  GBytes     *bytes;
+  char       *hash;
+} IconCacheEntry;
+
+static GMutex      icon_cache_lock;
+static GHashTable *icon_cache = NULL;
+static GQueue      icon_cache_queue = G_QUEUE_INIT;
+
+static void
+icon_cache_entry_free (gpointer data)
+{
+  IconCacheEntry *entry = data;
+
+  g_clear_object (&entry->icon);
+  g_clear_pointer (&entry->bytes, g_bytes_unref);
+  g_clear_pointer (&entry->hash, g_free);
+  g_free (entry);
+}
+
+static uint64_t
+icon_cache_get_mtime (GIcon        *icon,
+                      GCancellable *cancellable)
+{
+  g_autoptr (GFileInfo) info = NULL;
+  GFile *file;
+
+  if (!G_IS_FILE_ICON (icon))
+    return 0;
+
+  file = g_file_icon_get_file (G_FILE_ICON (icon));
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                            G_FILE_QUERY_INFO_NONE,
+                            cancellable,
+                            NULL);
+
+  if (info == NULL)
+    return 0;
+
+  return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+}
+
+static void
+icon_cache_remove_link (GList *link)
+{
+  IconCacheEntry *entry = link->data;
+
+  g_hash_table_remove (icon_cache, entry->icon);
+  g_queue_delete_link (&icon_cache_queue, link);
+  icon_cache_entry_free (entry);
+}
+
+static gboolean
+icon_cache_lookup (GIcon    *icon,
+                   uint64_t  mtime,
+                   GBytes  **bytes,
+                   char    **hash)
+{
+  IconCacheEntry *entry;
+  GList *link;
+
+  g_mutex_lock (&icon_cache_lock);
+  if (icon_cache == NULL ||
+      (link = g_hash_table_lookup (icon_cache, icon)) == NULL)
+    {
+      g_mutex_unlock (&icon_cache_lock);
+      return FALSE;
+    }
+
+  entry = link->data;
+
+  if (entry->mtime != mtime)
+    {
+      icon_cache_remove_link (link);
+      g_mutex_unlock (&icon_cache_lock);
+      return FALSE;
+    }
+
+  g_queue_unlink (&icon_cache_queue, link);
+  g_queue_push_head_link (&icon_cache_queue, link);
+
+  *bytes = g_bytes_ref (entry->bytes);
+  *hash = g_strdup (entry->hash);
+  g_mutex_unlock (&icon_cache_lock);
+
+  return TRUE;
+}
+
+static void
+icon_cache_insert (GIcon      *icon,
+                   uint64_t    mtime,
+                   GBytes     *bytes,
+                   const char *hash)
+{
+  IconCacheEntry *entry;
+  GList *link;
+
+  g_mutex_lock (&icon_cache_lock);
+  if (icon_cache == NULL)
+    icon_cache = g_hash_table_new (g_icon_hash, (GEqualFunc)g_icon_equal);
+
+  if ((link = g_hash_table_lookup (icon_cache, icon)) != NULL)
+    icon_cache_remove_link (link);
+
+  entry = g_new0 (IconCacheEntry, 1);
+  entry->icon = g_object_ref (icon);
+  entry->mtime = mtime;
+  entry->bytes = g_bytes_ref (bytes);
+  entry->hash = g_strdup (hash);
+
+  g_queue_push_head (&icon_cache_queue, entry);
+  g_hash_table_insert (icon_cache, entry->icon, icon_cache_queue.head);
+
+  while (icon_cache_queue.length > ICON_CACHE_SIZE)
+    icon_cache_remove_link (icon_cache_queue.tail);
+  g_mutex_unlock (&icon_cache_lock);
+}
+
 /*
  * ValentTransfer
  */
@@ -267,6 +437,7 @@ valent_notification_upload_execute_task (GTask        *task,
   g_autofree char *payload_hash = NULL;
   const uint8_t *payload_data = NULL;
   size_t payload_size = 0;
+  uint64_t mtime = 0;
   gboolean ret = FALSE;
   GError *error = NULL;
 
@@ -290,18 +461,29 @@ valent_notification_upload_execute_task (GTask        *task,
       return;
     }
 
-  /* Try to get the icon bytes */
-  bytes = valent_notification_upload_get_icon_bytes (icon, cancellable, &error);
+  /* Try to get the icon bytes, from the cache if possible */
+  mtime = icon_cache_get_mtime (icon, cancellable);
 
-  if (bytes == NULL)
-    return g_task_return_error (task, error);
+  if (icon_cache_lookup (icon, mtime, &bytes, &payload_hash))
+    {
+      payload_data = g_bytes_get_data (bytes, &payload_size);
+    }
+  else
+    {
+      bytes = valent_notification_upload_get_icon_bytes (icon, cancellable, &error);
+
+      if (bytes == NULL)
+        return g_task_return_error (task, error);
+
+      payload_data = g_bytes_get_data (bytes, &payload_size);
+      payload_hash = g_compute_checksum_for_data (G_CHECKSUM_MD5,
+                                                  payload_data,
+                                                  payload_size);
+      icon_cache_insert (icon, mtime, bytes, payload_hash);
+    }
 
   /* A payload hash is included, allowing the remote device to ignore icon
    * transfers that it already has cached. */
-  payload_data = g_bytes_get_data (bytes, &payload_size);
-  payload_hash = g_compute_checksum_for_data (G_CHECKSUM_MD5,
-                                              payload_data,
-                                              payload_size);
   json_object_set_string_member (valent_packet_get_body (packet),
                                  "payloadHash",
                                  payload_hash);
@@ -10,6 +10,8 @@
 
 #include "valent-share-upload.h"
 
+#define VALENT_SHARE_UPLOAD_MAX_ACTIVE (4)
+
 
 /**
  * ValentShareUpload:
@@ -30,10 +32,20 @@ struct _ValentShareUpload
   unsigned int    position;
   unsigned int    processing_files;
   goffset         payload_size;
+
+  /* Execution */
+  GPtrArray      *active;
+  unsigned int    max_active;
+  unsigned int    n_failed;
+  goffset         transferred_size;
+  GError         *error;
 };
 
-static void       g_list_model_iface_init  (GListModelInterface *iface);
-static gboolean   valent_share_upload_idle (gpointer             data);
+static void       g_list_model_iface_init    (GListModelInterface *iface);
+static gboolean   valent_share_upload_idle   (gpointer             data);
+static void       valent_transfer_execute_cb (GObject             *object,
+                                              GAsyncResult        *result,
+                                              gpointer             user_data);
 
 G_DEFINE_FINAL_TYPE_WITH_CODE (ValentShareUpload, valent_share_upload, VALENT_TYPE_TRANSFER,
                                G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, g_list_model_iface_init))
@@ -41,6 +53,7 @@ G_DEFINE_FINAL_TYPE_WITH_CODE (ValentShareUpload, valent_share_upload, VALENT_TY
 enum {
   PROP_0,
   PROP_DEVICE,
+  PROP_MAX_ACTIVE,
   N_PROPERTIES,
 };
 
@@ -81,6 +94,95 @@ valent_share_upload_update_transfer (ValentShareUpload *self,
   json_object_set_int_member (body, "totalPayloadSize", self->payload_size);
 }
 
+static void
+valent_share_upload_update_progress (ValentShareUpload *self)
+{
+  double transferred = self->transferred_size;
+  double progress;
+
+  g_assert (VALENT_IS_SHARE_UPLOAD (self));
+
+  if (self->payload_size == 0)
+    return;
+
+  for (unsigned int i = 0; i < self->active->len; i++)
+    {
+      ValentTransfer *item = g_ptr_array_index (self->active, i);
+      g_autoptr (JsonNode) packet = NULL;
+
+      packet = valent_device_transfer_ref_packet (VALENT_DEVICE_TRANSFER (item));
+      transferred += valent_transfer_get_progress (item) *
+                     valent_packet_get_payload_size (packet);
+    }
+
+  progress = CLAMP (transferred / self->payload_size, 0.0, 1.0);
+  valent_transfer_set_progress (VALENT_TRANSFER (self), progress);
+}
+
+static void
+on_item_progress (ValentTransfer    *item,
+                  GParamSpec        *pspec,
+                  ValentShareUpload *self)
+{
+  valent_share_upload_update_progress (self);
+}
+
+/*
+ * Start as many pending items as the window allows. Each transfer negotiates
+ * its own connection, so running several at once hides the per-file setup
+ * latency when sharing many small files.
+ */
+static void
+valent_share_upload_execute_next (ValentShareUpload *self,
+                                  GTask             *task)
+{
+  GCancellable *cancellable = g_task_get_cancellable (task);
+
+  g_assert (VALENT_IS_SHARE_UPLOAD (self));
+  g_assert (G_IS_TASK (task));
+
+  while (self->active->len < self->max_active &&
+         self->position < self->items->len &&
+         !g_cancellable_is_cancelled (cancellable))
+    {
+      ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
+
+      g_ptr_array_add (self->active, g_object_ref (item));
+      g_signal_connect_object (item,
+                               "notify::progress",
+                               G_CALLBACK (on_item_progress),
+                               self, 0);
+
+      valent_share_upload_update_transfer (self, item);
+      valent_transfer_execute (item,
+                               cancellable,
+                               valent_transfer_execute_cb,
+                               g_object_ref (task));
+    }
+}
+
+static void
+valent_share_upload_return (ValentShareUpload *self,
+                            GTask             *task)
+{
+  g_assert (VALENT_IS_SHARE_UPLOAD (self));
+  g_assert (G_IS_TASK (task));
+
+  if (self->error == NULL)
+    {
+      g_task_return_boolean (task, TRUE);
+      return;
+    }
+
+  g_task_return_new_error (task,
+                           self->error->domain,
+                           self->error->code,
+                           "Failed to upload %u of %u files: %s",
+                           self->n_failed,
+                           self->items->len,
+                           self->error->message);
+}
+
 static void
 valent_transfer_execute_cb (GObject      *object,
                             GAsyncResult *result,
@@ -89,32 +191,37 @@ valent_transfer_execute_cb (GObject      *object,
   ValentTransfer *transfer = VALENT_TRANSFER (object);
   ValentShareUpload *self = g_task_get_source_object (G_TASK (user_data));
   g_autoptr (GTask) task = G_TASK (user_data);
+  g_autoptr (JsonNode) packet = NULL;
   g_autoptr (GError) error = NULL;
 
-  if (!valent_transfer_execute_finish (transfer, result, &error))
-    return g_task_return_error (task, g_steal_pointer (&error));
-
-  if (self->position < self->items->len)
+  /* A failed item is reported by its own state; the remaining items are
+   * still uploaded and the error is propagated when the batch completes. */
+  if (!valent_transfer_execute_finish (transfer, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
-      ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
+      g_debug ("%s(): %s", G_STRFUNC, error->message);
 
-      valent_share_upload_update_transfer (self, item);
-      valent_transfer_execute (item,
-                               g_task_get_cancellable (task),
-                               valent_transfer_execute_cb,
-                               g_object_ref (task));
+      if (self->error == NULL)
+        self->error = g_steal_pointer (&error);
+      self->n_failed++;
     }
-  else if (self->processing_files)
+
+  g_signal_handlers_disconnect_by_func (transfer, on_item_progress, self);
+  g_ptr_array_remove_fast (self->active, transfer);
+
+  packet = valent_device_transfer_ref_packet (VALENT_DEVICE_TRANSFER (transfer));
+  self->transferred_size += valent_packet_get_payload_size (packet);
+  valent_share_upload_update_progress (self);
+
+  valent_share_upload_execute_next (self, task);
+
+  if (self->active->len == 0)
     {
       g_autoptr (GSource) source = NULL;
 
       source = g_idle_source_new ();
       g_task_attach_source (task, source, valent_share_upload_idle);
     }
-  else
-    {
-      g_task_return_boolean (task, TRUE);
-    }
 }
 
 static gboolean
@@ -126,24 +233,15 @@ valent_share_upload_idle (gpointer data)
   if (g_task_return_error_if_cancelled (task))
     return G_SOURCE_REMOVE;
 
-  if (self->position < self->items->len)
-    {
-      ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
+  valent_share_upload_execute_next (self, task);
 
-      valent_share_upload_update_transfer (self, item);
-      valent_transfer_execute (item,
-                               g_task_get_cancellable (task),
-                               valent_transfer_execute_cb,
-                               g_object_ref (task));
+  if (self->active->len > 0)
+    return G_SOURCE_REMOVE;
 
-      return G_SOURCE_REMOVE;
-    }
-  else if (self->processing_files)
-    {
-      return G_SOURCE_CONTINUE;
-    }
+  if (self->processing_files)
+    return G_SOURCE_CONTINUE;
 
-  g_task_return_boolean (task, TRUE);
+  valent_share_upload_return (self, task);
   return G_SOURCE_REMOVE;
 }
 
@@ -219,6 +317,8 @@ valent_share_upload_finalize (GObject *object)
   valent_object_lock (VALENT_OBJECT (self));
   g_clear_object (&self->device);
   g_clear_pointer (&self->items, g_ptr_array_unref);
+  g_clear_pointer (&self->active, g_ptr_array_unref);
+  g_clear_error (&self->error);
   valent_object_unlock (VALENT_OBJECT (self));
 
   G_OBJECT_CLASS (valent_share_upload_parent_class)->finalize (object);
@@ -240,6 +340,10 @@ valent_share_upload_get_property (GObject    *object,
       valent_object_unlock (VALENT_OBJECT (self));
       break;
 
+    case PROP_MAX_ACTIVE:
+      g_value_set_uint (value, self->max_active);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -261,6 +365,14 @@ valent_share_upload_set_property (GObject      *object,
       valent_object_unlock (VALENT_OBJECT (self));
       break;
 
+    case PROP_MAX_ACTIVE:
+      if (self->max_active != g_value_get_uint (value))
+        {
+          self->max_active = g_value_get_uint (value);
+          g_object_notify_by_pspec (object, pspec);
+        }
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -291,6 +403,22 @@ valent_share_upload_class_init (ValentShareUploadClass *klass)
                           G_PARAM_EXPLICIT_NOTIFY |
                           G_PARAM_STATIC_STRINGS));
 
+  /**
+   * ValentShareUpload:max-active:
+   *
+   * The maximum number of files to upload concurrently.
+   *
+   * Changes take effect the next time a file transfer is started.
+   */
+  properties [PROP_MAX_ACTIVE] =
+    g_param_spec_uint ("max-active", NULL, NULL,
+                       1, G_MAXUINT,
+                       VALENT_SHARE_UPLOAD_MAX_ACTIVE,
+                       (G_PARAM_READWRITE |
+                        G_PARAM_CONSTRUCT |
+                        G_PARAM_EXPLICIT_NOTIFY |
+                        G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -298,6 +426,8 @@ static void
 valent_share_upload_init (ValentShareUpload *self)
 {
   self->items = g_ptr_array_new_with_free_func (g_object_unref);
+  self->active = g_ptr_array_new_with_free_func (g_object_unref);
+  self->max_active = VALENT_SHARE_UPLOAD_MAX_ACTIVE;
 }
 
 /**
@@ -14,6 +14,9 @@
 #include "valent-sms-store.h"
 #include "valent-sms-store-private.h"
 
+/* The number of messages hydrated ahead of a request, in scroll direction */
+#define HYDRATE_READ_AHEAD (50)
+
 
 struct _ValentMessageThread
 {
@@ -28,6 +31,12 @@ struct _ValentMessageThread
   unsigned int    last_position;
   GSequenceIter  *last_iter;
   gboolean        last_position_valid;
+
+  /* hydration */
+  GHashTable     *pending;
+  unsigned int    hydrate_start;
+  unsigned int    hydrate_end;
+  unsigned int    hydrate_id;
 };
 
 static void   g_list_model_iface_init (GListModelInterface *iface);
@@ -127,21 +136,190 @@ valent_message_thread_add_message (ValentMessageThread *self,
 }
 #endif
 
+typedef struct
+{
+  ValentMessageThread *thread;
+  GPtrArray           *messages;
+} HydrateRequest;
+
+static void
+hydrate_request_free (gpointer data)
+{
+  HydrateRequest *request = data;
+
+  g_clear_object (&request->thread);
+  g_clear_pointer (&request->messages, g_ptr_array_unref);
+  g_free (request);
+}
+
 static void
-get_message_cb (ValentSmsStore *store,
-                GAsyncResult   *result,
-                gpointer        user_data)
+get_thread_range_cb (ValentSmsStore *store,
+                     GAsyncResult   *result,
+                     gpointer        user_data)
 {
-  g_autoptr (ValentMessage) message = VALENT_MESSAGE (user_data);
-  g_autoptr (ValentMessage) update = NULL;
+  HydrateRequest *request = user_data;
+  ValentMessageThread *self = request->thread;
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GHashTable) index = NULL;
   g_autoptr (GError) error = NULL;
 
-  update = valent_sms_store_get_message_finish (store, result, &error);
+  for (unsigned int i = 0; i < request->messages->len; i++)
+    g_hash_table_remove (self->pending, g_ptr_array_index (request->messages, i));
+
+  if ((messages = g_task_propagate_pointer (G_TASK (result), &error)) == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      hydrate_request_free (request);
+      return;
+    }
+
+  index = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+  for (unsigned int i = 0; i < messages->len; i++)
+    {
+      ValentMessage *message = g_ptr_array_index (messages, i);
+      int64_t id = valent_message_get_id (message);
+
+      g_hash_table_insert (index, g_memdup2 (&id, sizeof (int64_t)), message);
+      valent_sms_store_cache_message (store, message);
+    }
+
+  for (unsigned int i = 0; i < request->messages->len; i++)
+    {
+      ValentMessage *placeholder = g_ptr_array_index (request->messages, i);
+      ValentMessage *message = NULL;
+      int64_t id = valent_message_get_id (placeholder);
+
+      if ((message = g_hash_table_lookup (index, &id)) != NULL)
+        valent_message_update (placeholder, g_object_ref (message));
+    }
+
+  hydrate_request_free (request);
+}
+
+static void
+valent_message_thread_flush (ValentMessageThread *self)
+{
+  HydrateRequest *request = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  GSequenceIter *it;
+  int64_t start_date, end_date;
+
+  g_clear_handle_id (&self->hydrate_id, g_source_remove);
 
-  if (update == NULL)
-    g_warning ("%s: %s", G_STRFUNC, error->message);
+  if (self->hydrate_start >= self->hydrate_end)
+    return;
+
+  messages = g_ptr_array_new_with_free_func (g_object_unref);
+  it = g_sequence_get_iter_at_pos (self->items, self->hydrate_start);
+
+  for (unsigned int i = self->hydrate_start; i < self->hydrate_end; i++)
+    {
+      ValentMessage *message;
+
+      if (g_sequence_iter_is_end (it))
+        break;
+
+      message = g_sequence_get (it);
+      it = g_sequence_iter_next (it);
+
+      if (valent_message_get_box (message) != 0 ||
+          g_hash_table_contains (self->pending, message))
+        continue;
+
+      g_hash_table_add (self->pending, message);
+      g_ptr_array_add (messages, g_object_ref (message));
+    }
+
+  self->hydrate_start = 0;
+  self->hydrate_end = 0;
+
+  if (messages->len == 0)
+    return;
+
+  /* Items are sorted by date, so the first and last bound the range */
+  start_date = valent_message_get_date (g_ptr_array_index (messages, 0));
+  end_date = valent_message_get_date (g_ptr_array_index (messages,
+                                                         messages->len - 1));
+
+  VALENT_NOTE ("thread %"G_GINT64_FORMAT": hydrating %u messages",
+               self->id,
+               messages->len);
+
+  request = g_new0 (HydrateRequest, 1);
+  request->thread = g_object_ref (self);
+  request->messages = g_steal_pointer (&messages);
+  valent_sms_store_get_thread_range (self->store,
+                                     self->id,
+                                     start_date,
+                                     end_date,
+                                     self->cancellable,
+                                     (GAsyncReadyCallback)get_thread_range_cb,
+                                     request);
+}
+
+static gboolean
+valent_message_thread_flush_idle (gpointer data)
+{
+  ValentMessageThread *self = VALENT_MESSAGE_THREAD (data);
+
+  self->hydrate_id = 0;
+  valent_message_thread_flush (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Queue the window around @position for hydration, reading ahead in the
+ * direction of travel. Requests for nearby positions made in the same main
+ * loop iteration are merged into a single range query.
+ */
+static void
+valent_message_thread_hydrate (ValentMessageThread *self,
+                               unsigned int         position,
+                               gboolean             forward)
+{
+  unsigned int n_items = g_sequence_get_length (self->items);
+  unsigned int start, end;
+
+  if (forward)
+    {
+      start = position;
+      end = MIN (n_items, position + HYDRATE_READ_AHEAD);
+    }
+  else
+    {
+      start = position >= HYDRATE_READ_AHEAD
+            ? position - HYDRATE_READ_AHEAD + 1
+            : 0;
+      end = position + 1;
+    }
+
+  /* Flush a pending range that can't be merged with this one */
+  if (self->hydrate_start < self->hydrate_end &&
+      (end < self->hydrate_start || start > self->hydrate_end))
+    valent_message_thread_flush (self);
+
+  if (self->hydrate_start < self->hydrate_end)
+    {
+      self->hydrate_start = MIN (self->hydrate_start, start);
+      self->hydrate_end = MAX (self->hydrate_end, end);
+    }
   else
-    valent_message_update (message, g_steal_pointer (&update));
+    {
+      self->hydrate_start = start;
+      self->hydrate_end = end;
+    }
+
+  if (self->hydrate_id == 0)
+    {
+      self->hydrate_id = g_idle_add_full (G_PRIORITY_DEFAULT,
+                                          valent_message_thread_flush_idle,
+                                          self,
+                                          NULL);
+    }
 }
 
 static void
@@ -169,9 +347,18 @@ get_thread_items_cb (ValentSmsStore *store,
   for (unsigned int i = 0; i < n_items; i++)
     {
       ValentMessage *message;
+      ValentMessage *cached;
 
+      /* Prefer a message already hydrated for another thread or view */
       message = g_ptr_array_index (messages, i);
-      g_sequence_append (self->items, g_object_ref (message));
+      cached = valent_sms_store_lookup_message (store,
+                                                self->id,
+                                                valent_message_get_id (message));
+
+      if (cached != NULL)
+        g_sequence_append (self->items, cached);
+      else
+        g_sequence_append (self->items, g_object_ref (message));
     }
 
   g_list_model_items_changed (G_LIST_MODEL (self), 0, 0, n_items);
@@ -202,6 +389,7 @@ valent_message_thread_get_item (GListModel   *model,
   ValentMessageThread *self = VALENT_MESSAGE_THREAD (model);
   ValentMessage *message = NULL;
   GSequenceIter *it = NULL;
+  gboolean forward = TRUE;
 
   if (self->last_position_valid)
     {
@@ -216,6 +404,9 @@ valent_message_thread_get_item (GListModel   *model,
   if (it == NULL)
     it = g_sequence_get_iter_at_pos (self->items, position);
 
+  if (self->last_position_valid)
+    forward = position >= self->last_position;
+
   self->last_iter = it;
   self->last_position = position;
   self->last_position_valid = TRUE;
@@ -226,14 +417,9 @@ valent_message_thread_get_item (GListModel   *model,
   message = g_object_ref (g_sequence_get (it));
 
   /* Lazy fetch */
-  if (valent_message_get_box (message) == 0)
-    {
-      valent_sms_store_get_message (self->store,
-                                    valent_message_get_id (message),
-                                    self->cancellable,
-                                    (GAsyncReadyCallback)get_message_cb,
-                                    g_object_ref (message));
-    }
+  if (valent_message_get_box (message) == 0 &&
+      !g_hash_table_contains (self->pending, message))
+    valent_message_thread_hydrate (self, position, forward);
 
   return message;
 }
@@ -256,6 +442,7 @@ valent_message_thread_dispose (GObject *object)
   ValentMessageThread *self = VALENT_MESSAGE_THREAD (object);
 
   g_cancellable_cancel (self->cancellable);
+  g_clear_handle_id (&self->hydrate_id, g_source_remove);
 
   G_OBJECT_CLASS (valent_message_thread_parent_class)->dispose (object);
 }
@@ -267,6 +454,7 @@ valent_message_thread_finalize (GObject *object)
 
   g_clear_object (&self->store);
   g_clear_pointer (&self->items, g_sequence_free);
+  g_clear_pointer (&self->pending, g_hash_table_unref);
   g_clear_object (&self->cancellable);
 
   G_OBJECT_CLASS (valent_message_thread_parent_class)->finalize (object);
@@ -363,6 +551,7 @@ valent_message_thread_init (ValentMessageThread *self)
 {
   self->cancellable = g_cancellable_new ();
   self->items = g_sequence_new (g_object_unref);
+  self->pending = g_hash_table_new (NULL, NULL);
 }
 
 /**
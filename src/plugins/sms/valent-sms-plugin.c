@@ -15,6 +15,18 @@
 #include "valent-sms-store.h"
 #include "valent-sms-window.h"
 
+/* The number of messages requested in each page of thread history */
+#define BACKFILL_PAGE_SIZE (100)
+
+/* The maximum number of page requests awaiting a response */
+#define BACKFILL_MAX_PENDING (2)
+
+/* The number of seconds paging is paused after messages are sent or received */
+#define BACKFILL_PAUSE_SECONDS (5)
+
+/* The number of seconds a page request may go unanswered */
+#define BACKFILL_TIMEOUT_SECONDS (30)
+
 
 struct _ValentSmsPlugin
 {
@@ -22,8 +34,15 @@ struct _ValentSmsPlugin
 
   ValentSmsStore    *store;
   GtkWindow         *window;
+
+  /* history backfill */
+  GQueue             backfill;
+  GHashTable        *backfill_pending;
+  unsigned int       backfill_pause_id;
+  unsigned int       backfill_serial;
 };
 
+static void            valent_sms_plugin_backfill_schedule     (ValentSmsPlugin *self);
 static ValentMessage * valent_sms_plugin_deserialize_message   (ValentSmsPlugin *self,
                                                                 JsonNode        *node);
 static void            valent_sms_plugin_request               (ValentSmsPlugin *self,
@@ -195,12 +214,224 @@ messages_is_thread (JsonArray *messages)
   return first == second;
 }
 
+/*
+ * History Backfill
+ *
+ * Stale threads are fetched in pages of BACKFILL_PAGE_SIZE messages, from the
+ * most recently active thread to the least, with no more than
+ * BACKFILL_MAX_PENDING requests awaiting a response. Each page requests the
+ * messages older than the last, until the history overlaps the store or runs
+ * out. Paging is paused while messages are being sent or received.
+ *
+ * A reply is matched to a pending thread by its ID and date range, since a new
+ * message in the same thread arrives in the same kind of packet. A reply
+ * without messages can't be matched to a thread, so it is taken as the end of
+ * the oldest pending request; a request without a reply is abandoned after
+ * BACKFILL_TIMEOUT_SECONDS, so the slot is not held forever.
+ */
+typedef struct
+{
+  int64_t          thread_id;
+  int64_t          thread_date;
+  int64_t          cache_date;
+  int64_t          page_date;
+  ValentSmsPlugin *plugin;
+  unsigned int     serial;
+  unsigned int     timeout_id;
+} BackfillThread;
+
+static void
+backfill_thread_free (gpointer data)
+{
+  BackfillThread *thread = data;
+
+  g_clear_handle_id (&thread->timeout_id, g_source_remove);
+  g_free (thread);
+}
+
+static int
+backfill_thread_compare (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
+{
+  const BackfillThread *thread1 = a;
+  const BackfillThread *thread2 = b;
+
+  if (thread1->thread_date > thread2->thread_date)
+    return -1;
+
+  return thread1->thread_date < thread2->thread_date ? 1 : 0;
+}
+
+static gboolean
+valent_sms_plugin_backfill_timeout (gpointer data)
+{
+  BackfillThread *thread = data;
+  ValentSmsPlugin *self = thread->plugin;
+
+  thread->timeout_id = 0;
+  g_hash_table_remove (self->backfill_pending, &thread->thread_id);
+  valent_sms_plugin_backfill_schedule (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+valent_sms_plugin_backfill_schedule (ValentSmsPlugin *self)
+{
+  BackfillThread *thread;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  if (self->backfill_pause_id != 0)
+    return;
+
+  while (g_hash_table_size (self->backfill_pending) < BACKFILL_MAX_PENDING &&
+         (thread = g_queue_pop_head (&self->backfill)) != NULL)
+    {
+      thread->plugin = self;
+      thread->serial = self->backfill_serial++;
+      thread->timeout_id = g_timeout_add_seconds (BACKFILL_TIMEOUT_SECONDS,
+                                                  valent_sms_plugin_backfill_timeout,
+                                                  thread);
+      g_hash_table_add (self->backfill_pending, thread);
+      valent_sms_plugin_request_conversation (self,
+                                              thread->thread_id,
+                                              thread->page_date,
+                                              BACKFILL_PAGE_SIZE);
+    }
+}
+
+static void
+valent_sms_plugin_backfill_queue (ValentSmsPlugin *self,
+                                  int64_t          thread_id,
+                                  int64_t          thread_date,
+                                  int64_t          cache_date)
+{
+  BackfillThread *thread;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  /* A thread with a request in flight will be requeued with its response */
+  if (g_hash_table_contains (self->backfill_pending, &thread_id))
+    return;
+
+  thread = g_new0 (BackfillThread, 1);
+  thread->thread_id = thread_id;
+  thread->thread_date = thread_date;
+  thread->cache_date = cache_date;
+  g_queue_insert_sorted (&self->backfill, thread, backfill_thread_compare, NULL);
+}
+
+static gboolean
+valent_sms_plugin_backfill_page (ValentSmsPlugin *self,
+                                 int64_t          thread_id,
+                                 unsigned int     n_messages,
+                                 int64_t          oldest_date,
+                                 int64_t          newest_date)
+{
+  BackfillThread *thread = NULL;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  thread = g_hash_table_lookup (self->backfill_pending, &thread_id);
+
+  if (thread == NULL)
+    return FALSE;
+
+  /* A single message newer than the thread was when it was queued is a new
+   * message, and a page never includes messages newer than its start date */
+  if ((n_messages == 1 && newest_date > thread->thread_date) ||
+      (thread->page_date > 0 && newest_date > thread->page_date))
+    return FALSE;
+
+  g_hash_table_steal (self->backfill_pending, &thread_id);
+  g_clear_handle_id (&thread->timeout_id, g_source_remove);
+
+  /* Request the next page, unless the history is exhausted, it overlaps the
+   * store, or the last page made no progress */
+  if (n_messages >= BACKFILL_PAGE_SIZE &&
+      oldest_date > thread->cache_date &&
+      (thread->page_date == 0 || oldest_date < thread->page_date))
+    {
+      thread->page_date = oldest_date;
+      g_queue_insert_sorted (&self->backfill, thread, backfill_thread_compare, NULL);
+    }
+  else
+    {
+      backfill_thread_free (thread);
+    }
+
+  valent_sms_plugin_backfill_schedule (self);
+
+  return TRUE;
+}
+
+static void
+valent_sms_plugin_backfill_empty (ValentSmsPlugin *self)
+{
+  GHashTableIter iter;
+  BackfillThread *thread;
+  BackfillThread *oldest = NULL;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  /* Requests are answered in order, so an empty page ends the oldest one */
+  g_hash_table_iter_init (&iter, self->backfill_pending);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&thread, NULL))
+    {
+      if (oldest == NULL || thread->serial < oldest->serial)
+        oldest = thread;
+    }
+
+  if (oldest == NULL)
+    return;
+
+  g_hash_table_remove (self->backfill_pending, &oldest->thread_id);
+  valent_sms_plugin_backfill_schedule (self);
+}
+
+static gboolean
+valent_sms_plugin_backfill_resume (gpointer data)
+{
+  ValentSmsPlugin *self = VALENT_SMS_PLUGIN (data);
+
+  self->backfill_pause_id = 0;
+  valent_sms_plugin_backfill_schedule (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+valent_sms_plugin_backfill_pause (ValentSmsPlugin *self)
+{
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  g_clear_handle_id (&self->backfill_pause_id, g_source_remove);
+  self->backfill_pause_id = g_timeout_add_seconds (BACKFILL_PAUSE_SECONDS,
+                                                   valent_sms_plugin_backfill_resume,
+                                                   self);
+}
+
+static void
+valent_sms_plugin_backfill_reset (ValentSmsPlugin *self)
+{
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+
+  g_clear_handle_id (&self->backfill_pause_id, g_source_remove);
+  g_queue_clear_full (&self->backfill, backfill_thread_free);
+  g_hash_table_remove_all (self->backfill_pending);
+}
+
 static void
 valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
                                  JsonArray       *messages)
 {
   g_autoptr (GPtrArray) results = NULL;
   unsigned int n_messages;
+  int64_t thread_id = -1;
+  int64_t oldest_date = G_MAXINT64;
+  int64_t newest_date = 0;
 
   g_assert (VALENT_IS_SMS_PLUGIN (self));
   g_assert (messages != NULL);
@@ -216,19 +447,94 @@ valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
 
       message_node = json_array_get_element (messages, i);
       message = valent_sms_plugin_deserialize_message (self, message_node);
+
+      if (message == NULL)
+        continue;
+
+      thread_id = valent_message_get_thread_id (message);
+      oldest_date = MIN (oldest_date, valent_message_get_date (message));
+      newest_date = MAX (newest_date, valent_message_get_date (message));
       g_ptr_array_add (results, message);
     }
 
   valent_sms_store_add_messages (self->store, results, NULL, NULL, NULL);
+
+  /* Anything other than a requested page is a message being sent or received,
+   * so pause paging to keep the connection responsive */
+  if (results->len == 0 ||
+      !valent_sms_plugin_backfill_page (self,
+                                        thread_id,
+                                        n_messages,
+                                        oldest_date,
+                                        newest_date))
+    valent_sms_plugin_backfill_pause (self);
+}
+
+typedef struct
+{
+  ValentSmsPlugin *plugin;
+  GArray          *thread_ids;
+  GArray          *thread_dates;
+} SummaryData;
+
+static void
+summary_data_free (gpointer data)
+{
+  SummaryData *summary = data;
+
+  g_clear_pointer (&summary->thread_ids, g_array_unref);
+  g_clear_pointer (&summary->thread_dates, g_array_unref);
+  g_free (summary);
+}
+
+static void
+valent_sms_store_get_thread_dates_cb (ValentSmsStore *store,
+                                      GAsyncResult   *result,
+                                      gpointer        user_data)
+{
+  SummaryData *summary = user_data;
+  ValentSmsPlugin *self = summary->plugin;
+  g_autoptr (GArray) cache_dates = NULL;
+  g_autoptr (GError) error = NULL;
+
+  cache_dates = valent_sms_store_get_thread_dates_finish (store, result, &error);
+
+  if (cache_dates == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&summary, summary_data_free);
+      return;
+    }
+
+  /* Queue each thread with messages newer than the last cached date, replacing
+   * any threads queued from a previous summary */
+  g_queue_clear_full (&self->backfill, backfill_thread_free);
+
+  for (unsigned int i = 0; i < cache_dates->len; i++)
+    {
+      int64_t thread_id = g_array_index (summary->thread_ids, int64_t, i);
+      int64_t thread_date = g_array_index (summary->thread_dates, int64_t, i);
+      int64_t cache_date = g_array_index (cache_dates, int64_t, i);
+
+      if (cache_date < thread_date)
+        valent_sms_plugin_backfill_queue (self, thread_id, thread_date, cache_date);
+    }
+
+  valent_sms_plugin_backfill_schedule (self);
+  g_clear_pointer (&summary, summary_data_free);
 }
 
 static void
 valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
                                    JsonNode        *packet)
 {
+  g_autoptr (GCancellable) destroy = NULL;
   JsonObject *body;
   JsonArray *messages;
   unsigned int n_messages;
+  SummaryData *summary;
 
   g_assert (VALENT_IS_SMS_PLUGIN (self));
   g_assert (VALENT_IS_PACKET (packet));
@@ -238,9 +544,13 @@ valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
   n_messages = json_array_get_length (messages);
 
   /* This would typically mean "all threads have been deleted", but it's more
-   * reasonable to assume this was the result of an error. */
+   * reasonable to assume this was the result of an error, or a page request
+   * that reached the end of a thread. */
   if (n_messages == 0)
-    return;
+    {
+      valent_sms_plugin_backfill_empty (self);
+      return;
+    }
 
   /* If this is a thread of messages we'll add them to the store */
   if (messages_is_thread (messages))
@@ -249,24 +559,33 @@ valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
       return;
     }
 
-  /* If this is a summary of threads we'll request each new thread */
+  /* If this is a summary of threads, look up the last cached date of every
+   * thread in a single pass and request those with newer messages */
+  summary = g_new0 (SummaryData, 1);
+  summary->plugin = self;
+  summary->thread_ids = g_array_sized_new (FALSE, FALSE, sizeof (int64_t), n_messages);
+  summary->thread_dates = g_array_sized_new (FALSE, FALSE, sizeof (int64_t), n_messages);
+
   for (unsigned int i = 0; i < n_messages; i++)
     {
       JsonObject *message;
       int64_t thread_id;
       int64_t thread_date;
-      int64_t cache_date;
 
       message = json_array_get_object_element (messages, i);
       thread_id = json_object_get_int_member (message, "thread_id");
       thread_date = json_object_get_int_member (message, "date");
 
-      /* Get the last cached date and compare timestamps */
-      cache_date = valent_sms_store_get_thread_date (self->store, thread_id);
-
-      if (cache_date < thread_date)
-        valent_sms_plugin_request_conversation (self, thread_id, cache_date, 0);
+      g_array_append_val (summary->thread_ids, thread_id);
+      g_array_append_val (summary->thread_dates, thread_date);
     }
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  valent_sms_store_get_thread_dates (self->store,
+                                     summary->thread_ids,
+                                     destroy,
+                                     (GAsyncReadyCallback)valent_sms_store_get_thread_dates_cb,
+                                     summary);
 }
 
 static void
@@ -361,6 +680,7 @@ valent_sms_plugin_request (ValentSmsPlugin *self,
   packet = valent_packet_end (&builder);
 
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  valent_sms_plugin_backfill_pause (self);
 }
 
 /*
@@ -454,7 +774,10 @@ valent_sms_plugin_update_state (ValentDevicePlugin *plugin,
 
   valent_extension_toggle_actions (VALENT_EXTENSION (plugin), available);
 
-  /* Request summary of messages */
+  /* Request summary of messages, dropping any requests from a previous
+   * connection that will never be answered */
+  valent_sms_plugin_backfill_reset (self);
+
   if (available)
     valent_sms_plugin_request_conversations (self);
 }
@@ -519,6 +842,7 @@ valent_sms_plugin_dispose (GObject *object)
   /* Close message window and drop SMS Store */
   g_clear_pointer (&self->window, gtk_window_destroy);
   g_clear_object (&self->store);
+  valent_sms_plugin_backfill_reset (self);
 
   valent_device_plugin_set_menu_item (plugin, "device.sms.messaging", NULL);
 
@@ -533,6 +857,7 @@ valent_sms_plugin_finalize (GObject *object)
   if (self->window)
     g_clear_pointer (&self->window, gtk_window_destroy);
   g_clear_object (&self->store);
+  g_clear_pointer (&self->backfill_pending, g_hash_table_unref);
 
   G_OBJECT_CLASS (valent_sms_plugin_parent_class)->finalize (object);
 }
@@ -554,5 +879,10 @@ valent_sms_plugin_class_init (ValentSmsPluginClass *klass)
 static void
 valent_sms_plugin_init (ValentSmsPlugin *self)
 {
+  g_queue_init (&self->backfill);
+  self->backfill_pending = g_hash_table_new_full (g_int64_hash,
+                                                  g_int64_equal,
+                                                  NULL,
+                                                  backfill_thread_free);
 }
 
@@ -14,6 +14,18 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
                                            GCancellable        *cancellable,
                                            GAsyncReadyCallback  callback,
                                            gpointer             user_data);
+void   valent_sms_store_get_thread_range  (ValentSmsStore      *store,
+                                           int64_t              thread_id,
+                                           int64_t              start_date,
+                                           int64_t              end_date,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data);
+void   valent_sms_store_cache_message     (ValentSmsStore      *store,
+                                           ValentMessage       *message);
+ValentMessage * valent_sms_store_lookup_message (ValentSmsStore *store,
+                                                 int64_t         thread_id,
+                                                 int64_t         message_id);
 
 
 /**
@@ -27,6 +39,7 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
  * @sender: (type utf8): the sender address
  * @text: (type utf8): the message content
  * @thread_id: (type int64_t): a group ID
+ * @rowid: (type int64_t): the row ID
  *
  * The SQL query used to create the `message` table, which holds records of
  * abstract messages. The most commonly searched properties are fields, while
@@ -38,6 +51,10 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
  * column values are equivalent or safe to cast.
  *
  * Additional data is found in the @metadata #GVariant dictionary.
+ *
+ * The @rowid is declared explicitly so that it is stable across `VACUUM`,
+ * since the full-text index refers to rows by it. It is the last column, so
+ * that it does not shift the column IDs of the message properties.
  */
 #define MESSAGE_TABLE_SQL              \
 "CREATE TABLE IF NOT EXISTS message (" \
@@ -49,9 +66,85 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 "  sender    TEXT,"                    \
 "  text      TEXT    NOT NULL,"        \
 "  thread_id INTEGER NOT NULL,"        \
+"  rowid     INTEGER PRIMARY KEY,"     \
 "  UNIQUE(thread_id, id)"              \
 ");"
 
+/**
+ * MESSAGE_SCHEMA_VERSION:
+ *
+ * The current version of the database schema, stored as `user_version`.
+ */
+#define MESSAGE_SCHEMA_VERSION 1
+
+/**
+ * MESSAGE_MIGRATE_V1_SQL:
+ *
+ * The SQL query used to rebuild the `message` table for schema version 1, which
+ * declares the `rowid` column explicitly. Existing row IDs are preserved.
+ */
+#define MESSAGE_MIGRATE_V1_SQL                                               \
+"DROP TABLE IF EXISTS message_v1;"                                           \
+"ALTER TABLE message RENAME TO message_v1;"                                  \
+MESSAGE_TABLE_SQL                                                            \
+"INSERT INTO message(box,date,id,metadata,read,sender,text,thread_id,rowid)" \
+"  SELECT box,date,id,metadata,read,sender,text,thread_id,rowid"             \
+"    FROM message_v1;"                                                       \
+"DROP TABLE message_v1;"
+
+/**
+ * MESSAGE_INDEX_SQL:
+ *
+ * The SQL query used to create the indexes for the `message` table (schema
+ * version 1). The `(thread_id, date)` index serves the per-thread queries.
+ */
+#define MESSAGE_INDEX_SQL                                                     \
+"CREATE INDEX IF NOT EXISTS message_thread_date ON message(thread_id, date);"
+
+/**
+ * MESSAGE_FTS_SQL:
+ *
+ * The SQL query used to create the `message_fts` table, an external-content
+ * FTS5 index of @text, kept in sync by triggers and keyed by the `message`
+ * rowid column. The index is rebuilt from the existing rows.
+ *
+ * This is only used if sqlite was built with FTS5.
+ */
+#define MESSAGE_FTS_SQL                                                           \
+"CREATE VIRTUAL TABLE IF NOT EXISTS message_fts USING fts5("                      \
+"  text,"                                                                         \
+"  content='message',"                                                            \
+"  content_rowid='rowid',"                                                        \
+"  tokenize='unicode61 remove_diacritics 2'"                                      \
+");"                                                                              \
+"CREATE TRIGGER IF NOT EXISTS message_fts_insert AFTER INSERT ON message"         \
+"  BEGIN"                                                                         \
+"    INSERT INTO message_fts(rowid, text) VALUES (new.rowid, new.text);"          \
+"  END;"                                                                          \
+"CREATE TRIGGER IF NOT EXISTS message_fts_delete AFTER DELETE ON message"         \
+"  BEGIN"                                                                         \
+"    INSERT INTO message_fts(message_fts, rowid, text)"                           \
+"      VALUES ('delete', old.rowid, old.text);"                                   \
+"  END;"                                                                          \
+"CREATE TRIGGER IF NOT EXISTS message_fts_update AFTER UPDATE OF text ON message" \
+"  BEGIN"                                                                         \
+"    INSERT INTO message_fts(message_fts, rowid, text)"                           \
+"      VALUES ('delete', old.rowid, old.text);"                                   \
+"    INSERT INTO message_fts(rowid, text) VALUES (new.rowid, new.text);"          \
+"  END;"                                                                          \
+"INSERT INTO message_fts(message_fts) VALUES ('rebuild');"
+
+/**
+ * MESSAGE_FTS_DROP_SQL:
+ *
+ * The SQL query used to remove the `message_fts` triggers, if sqlite was built
+ * without FTS5. The triggers would otherwise fail every write to `message`.
+ */
+#define MESSAGE_FTS_DROP_SQL                                                      \
+"DROP TRIGGER IF EXISTS message_fts_insert;"                                      \
+"DROP TRIGGER IF EXISTS message_fts_delete;"                                      \
+"DROP TRIGGER IF EXISTS message_fts_update;"
+
 /**
  * ADD_MESSAGE_SQL:
  *
@@ -88,14 +181,37 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 /**
  * FIND_MESSAGES_SQL:
  *
- * Find the latest message in each thread matching the query.
+ * Find the latest message in each thread matching the FTS5 query, ordered by
+ * the best match in each thread.
  */
-#define FIND_MESSAGES_SQL                      \
-"SELECT * FROM message"                        \
-"  WHERE (thread_id, date) IN ("               \
-"    SELECT thread_id, MAX(date) FROM message" \
-"      WHERE text LIKE ? GROUP BY thread_id"   \
-"  );"
+#define FIND_MESSAGES_SQL                                                  \
+"SELECT message.* FROM message"                                            \
+"  JOIN ("                                                                 \
+"    SELECT message.thread_id AS thread_id,"                               \
+"           MAX(message.date) AS date,"                                    \
+"           MIN(message_fts.rank) AS rank"                                 \
+"      FROM message_fts"                                                   \
+"      JOIN message ON message.rowid = message_fts.rowid"                  \
+"      WHERE message_fts MATCH ?"                                          \
+"      GROUP BY message.thread_id"                                         \
+"  ) AS result"                                                            \
+"  ON message.thread_id = result.thread_id AND message.date = result.date" \
+"  ORDER BY result.rank ASC, message.date DESC;"
+
+/**
+ * FIND_MESSAGES_LIKE_SQL:
+ *
+ * Find the latest message in each thread matching the LIKE pattern. This is
+ * the fallback if sqlite was built without FTS5.
+ */
+#define FIND_MESSAGES_LIKE_SQL                                             \
+"SELECT message.* FROM message"                                            \
+"  JOIN ("                                                                 \
+"    SELECT thread_id, MAX(date) AS date FROM message"                     \
+"      WHERE text LIKE ? GROUP BY thread_id"                               \
+"  ) AS result"                                                            \
+"  ON message.thread_id = result.thread_id AND message.date = result.date" \
+"  ORDER BY message.date DESC;"
 
 /**
  * GET_MESSAGE_SQL:
@@ -106,6 +222,15 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 "SELECT * FROM message"                        \
 "  WHERE id=?;"                                \
 
+/**
+ * GET_MESSAGE_ROWID_SQL:
+ *
+ * Get the message for `rowid`.
+ */
+#define GET_MESSAGE_ROWID_SQL                  \
+"SELECT * FROM message"                        \
+"  WHERE rowid=?;"                             \
+
 /**
  * GET_THREAD_SQL:
  *
@@ -125,6 +250,16 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 "  WHERE thread_id=? ORDER BY date DESC"       \
 "  LIMIT 1;"
 
+/**
+ * GET_THREAD_DATES_SQL:
+ *
+ * Get the date of the most recent message for each thread, served by the
+ * `(thread_id, date)` index.
+ */
+#define GET_THREAD_DATES_SQL                   \
+"SELECT thread_id, MAX(date) FROM message"     \
+"  GROUP BY thread_id;"
+
 /**
  * GET_THREAD_ITEMS_SQL:
  *
@@ -134,18 +269,30 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 "SELECT date, id, sender FROM message"   \
 "  WHERE thread_id=? ORDER BY date ASC;"
 
+/**
+ * GET_THREAD_RANGE_SQL:
+ *
+ * Get the messages in @thread_id dated within a range, served by the
+ * `(thread_id, date)` index.
+ */
+#define GET_THREAD_RANGE_SQL                            \
+"SELECT * FROM message"                                 \
+"  WHERE thread_id=? AND date BETWEEN ? AND ?"          \
+"  ORDER BY date ASC;"
+
 /**
  * GET_SUMMARY_SQL:
  *
  * Get the most recent message for each thread.
  */
-#define GET_SUMMARY_SQL                        \
-"SELECT * FROM message"                        \
-"  WHERE (thread_id, date) IN ("               \
-"    SELECT thread_id, MAX(date) FROM message" \
-"    GROUP BY thread_id"                       \
-"  )"                                          \
-"  ORDER BY date DESC;"
+#define GET_SUMMARY_SQL                                                    \
+"SELECT message.* FROM message"                                            \
+"  JOIN ("                                                                 \
+"    SELECT thread_id, MAX(date) AS date FROM message"                     \
+"      GROUP BY thread_id"                                                 \
+"  ) AS latest"                                                            \
+"  ON message.thread_id = latest.thread_id AND message.date = latest.date" \
+"  ORDER BY message.date DESC;"
 
 G_END_DECLS
 
@@ -17,6 +17,12 @@
 /* Ensure that sqlite3_int64 is the same size as int64_t */
 G_STATIC_ASSERT (sizeof (sqlite3_int64) == sizeof (int64_t));
 
+/* The maximum number of messages written in a single transaction */
+#define MESSAGE_BATCH_SIZE (1000)
+
+/* The maximum number of hydrated messages kept in the cache */
+#define MESSAGE_CACHE_SIZE (1000)
+
 struct _ValentSmsStore
 {
   ValentContext    parent_instance;
@@ -24,9 +30,18 @@ struct _ValentSmsStore
   GAsyncQueue     *queue;
   sqlite3         *connection;
   char            *path;
-  sqlite3_stmt    *stmts[9];
+  sqlite3_stmt    *stmts[12];
 
   GListStore      *summary;
+
+  /* task thread */
+  GHashTable      *watermarks;
+  GArray          *events;
+  gboolean         fts;
+
+  /* main thread */
+  GHashTable      *cache;
+  GQueue           cache_queue;
 };
 
 G_DEFINE_FINAL_TYPE (ValentSmsStore, valent_sms_store, VALENT_TYPE_CONTEXT)
@@ -45,9 +60,12 @@ enum {
   STMT_REMOVE_MESSAGE,
   STMT_REMOVE_THREAD,
   STMT_GET_MESSAGE,
+  STMT_GET_MESSAGE_ROWID,
   STMT_GET_THREAD,
   STMT_GET_THREAD_DATE,
+  STMT_GET_THREAD_DATES,
   STMT_GET_THREAD_ITEMS,
+  STMT_GET_THREAD_RANGE,
   STMT_FIND_MESSAGES,
   STMT_GET_SUMMARY,
   N_STATEMENTS,
@@ -267,6 +285,155 @@ valent_sms_store_set_message_step (sqlite3_stmt   *stmt,
   return TRUE;
 }
 
+static inline gboolean
+valent_sms_store_exec (ValentSmsStore  *self,
+                       const char      *sql,
+                       GError         **error)
+{
+  int rc;
+
+  g_assert (VALENT_IS_SMS_STORE (self));
+  g_assert (sql != NULL);
+
+  if ((rc = sqlite3_exec (self->connection, sql, NULL, NULL, NULL)) != SQLITE_OK)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "sqlite3_exec(): \"%s\": [%i] %s",
+                   sql, rc, sqlite3_errstr (rc));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+valent_sms_store_migrate (ValentSmsStore  *self,
+                          GError         **error)
+{
+  sqlite3_stmt *stmt = NULL;
+  g_autofree char *version_sql = NULL;
+  int version = 0;
+
+  g_assert (VALENT_IS_SMS_STORE (self));
+
+  if (sqlite3_prepare_v2 (self->connection,
+                          "PRAGMA user_version;",
+                          -1,
+                          &stmt,
+                          NULL) == SQLITE_OK &&
+      sqlite3_step (stmt) == SQLITE_ROW)
+    version = sqlite3_column_int (stmt, 0);
+  g_clear_pointer (&stmt, sqlite3_finalize);
+
+  if (version >= MESSAGE_SCHEMA_VERSION)
+    return TRUE;
+
+  VALENT_NOTE ("migrating schema from version %i to %i",
+               version, MESSAGE_SCHEMA_VERSION);
+
+  version_sql = g_strdup_printf ("PRAGMA user_version = %i;",
+                                 MESSAGE_SCHEMA_VERSION);
+
+  if (!valent_sms_store_exec (self, "BEGIN;", error))
+    return FALSE;
+
+  /* Version 1 rebuilds the table with an explicit `rowid` column */
+  if (!valent_sms_store_exec (self, MESSAGE_MIGRATE_V1_SQL, error) ||
+      !valent_sms_store_exec (self, MESSAGE_INDEX_SQL, error) ||
+      !valent_sms_store_exec (self, version_sql, error) ||
+      !valent_sms_store_exec (self, "COMMIT;", error))
+    {
+      valent_sms_store_exec (self, "ROLLBACK;", NULL);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Prepare the full-text index, if sqlite was built with FTS5. Otherwise the
+ * triggers are dropped (in case the database was created by a build with FTS5),
+ * and searches fall back to a LIKE query.
+ */
+static gboolean
+valent_sms_store_prepare_fts (ValentSmsStore  *self,
+                              GError         **error)
+{
+  sqlite3_stmt *stmt = NULL;
+  gboolean exists = FALSE;
+
+  g_assert (VALENT_IS_SMS_STORE (self));
+
+  self->fts = sqlite3_compileoption_used ("ENABLE_FTS5");
+
+  if (!self->fts)
+    {
+      VALENT_NOTE ("FTS5 unavailable; using LIKE queries for search");
+      return valent_sms_store_exec (self, MESSAGE_FTS_DROP_SQL, error);
+    }
+
+  if (sqlite3_prepare_v2 (self->connection,
+                          "SELECT 1 FROM sqlite_master"
+                          "  WHERE type='trigger' AND name='message_fts_insert';",
+                          -1,
+                          &stmt,
+                          NULL) == SQLITE_OK &&
+      sqlite3_step (stmt) == SQLITE_ROW)
+    exists = TRUE;
+  g_clear_pointer (&stmt, sqlite3_finalize);
+
+  if (exists)
+    return TRUE;
+
+  if (!valent_sms_store_exec (self, "BEGIN;", error))
+    return FALSE;
+
+  if (!valent_sms_store_exec (self, MESSAGE_FTS_SQL, error) ||
+      !valent_sms_store_exec (self, "COMMIT;", error))
+    {
+      valent_sms_store_exec (self, "ROLLBACK;", NULL);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Convert a user query into an FTS5 phrase query, with the last term treated
+ * as a prefix. Double quotes are escaped so that the input is never parsed as
+ * FTS5 query syntax.
+ */
+static char *
+valent_sms_store_fts_query (const char *query)
+{
+  g_auto (GStrv) terms = NULL;
+  g_autoptr (GString) phrase = NULL;
+  g_autofree char *escaped = NULL;
+
+  terms = g_strsplit_set (query, " \t\n", -1);
+  phrase = g_string_new (NULL);
+
+  for (unsigned int i = 0; terms[i] != NULL; i++)
+    {
+      if (*terms[i] == '\0')
+        continue;
+
+      if (phrase->len > 0)
+        g_string_append_c (phrase, ' ');
+      g_string_append (phrase, terms[i]);
+    }
+
+  if (phrase->len == 0)
+    return NULL;
+
+  g_string_replace (phrase, "\"", "\"\"", 0);
+  escaped = g_string_free_and_steal (g_steal_pointer (&phrase));
+
+  return g_strdup_printf ("\"%s\" *", escaped);
+}
+
 static gboolean
 valent_sms_store_return_error_if_closed (GTask          *task,
                                          ValentSmsStore *self)
@@ -287,9 +454,209 @@ valent_sms_store_return_error_if_closed (GTask          *task,
 }
 
 
+/*
+ * Thread Watermarks
+ *
+ * The date of the latest message in each thread, loaded in a single query on
+ * first use and kept current as messages are written. An entry is marked stale
+ * if a write may have lowered its date, and is re-queried when next requested.
+ * The map is only ever accessed from the task thread.
+ */
+typedef struct
+{
+  int64_t   thread_id;
+  int64_t   date;
+  gboolean  stale;
+} Watermark;
+
+static gboolean
+valent_sms_store_load_watermarks (ValentSmsStore  *self,
+                                  GError         **error)
+{
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_THREAD_DATES];
+  g_autoptr (GHashTable) watermarks = NULL;
+  int rc;
+
+  if (self->watermarks != NULL)
+    return TRUE;
+
+  /* The key is the first member of the value, so both are freed together */
+  watermarks = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, g_free);
+
+  while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+      Watermark *watermark = g_new0 (Watermark, 1);
+
+      watermark->thread_id = sqlite3_column_int64 (stmt, 0);
+      watermark->date = sqlite3_column_int64 (stmt, 1);
+      g_hash_table_add (watermarks, watermark);
+    }
+
+  sqlite3_reset (stmt);
+
+  if (rc != SQLITE_DONE)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
+      return FALSE;
+    }
+
+  VALENT_NOTE ("loaded %u thread watermarks", g_hash_table_size (watermarks));
+  self->watermarks = g_steal_pointer (&watermarks);
+
+  return TRUE;
+}
+
+static void
+valent_sms_store_update_watermark (ValentSmsStore *self,
+                                   int64_t         thread_id,
+                                   int64_t         date)
+{
+  Watermark *watermark;
+
+  /* The watermarks will include this message when they are loaded */
+  if (self->watermarks == NULL)
+    return;
+
+  if ((watermark = g_hash_table_lookup (self->watermarks, &thread_id)) == NULL)
+    {
+      watermark = g_new0 (Watermark, 1);
+      watermark->thread_id = thread_id;
+      watermark->date = date;
+      g_hash_table_add (self->watermarks, watermark);
+    }
+  else if (date >= watermark->date)
+    {
+      watermark->date = date;
+      watermark->stale = FALSE;
+    }
+  else
+    {
+      /* Either an older message was added, or the latest message was updated
+       * with an earlier date; only the latter changes the watermark. */
+      watermark->stale = TRUE;
+    }
+}
+
+static gboolean
+valent_sms_store_get_watermark (ValentSmsStore  *self,
+                                int64_t          thread_id,
+                                int64_t         *date,
+                                GError         **error)
+{
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_THREAD_DATE];
+  Watermark *watermark;
+  int rc;
+
+  if (!valent_sms_store_load_watermarks (self, error))
+    return FALSE;
+
+  if ((watermark = g_hash_table_lookup (self->watermarks, &thread_id)) == NULL)
+    {
+      *date = 0;
+      return TRUE;
+    }
+
+  if (watermark->stale)
+    {
+      sqlite3_bind_int64 (stmt, 1, thread_id);
+
+      if ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+        watermark->date = sqlite3_column_int64 (stmt, 0);
+      else if (rc == SQLITE_DONE)
+        watermark->date = 0;
+
+      sqlite3_reset (stmt);
+
+      if (rc != SQLITE_DONE && rc != SQLITE_ROW)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_FAILED,
+                       "%s: %s", G_STRFUNC, sqlite3_errstr (rc));
+          return FALSE;
+        }
+
+      watermark->stale = FALSE;
+    }
+
+  *date = watermark->date;
+
+  return TRUE;
+}
+
+
 /*
  * Database Hooks
+ *
+ * Row changes are collected as they are reported by sqlite, and only announced
+ * once the write that caused them has been committed. If the transaction is
+ * rolled back, the changes are discarded.
  */
+typedef struct
+{
+  int            event;
+  ValentMessage *message;
+} RowEvent;
+
+static void
+row_event_clear (gpointer data)
+{
+  RowEvent *event = data;
+
+  g_clear_object (&event->message);
+}
+
+static void
+valent_sms_store_flush_events (ValentSmsStore *self,
+                               gboolean        committed)
+{
+  g_autoptr (GArray) events = NULL;
+
+  if (self->events == NULL || self->events->len == 0)
+    return;
+
+  events = g_steal_pointer (&self->events);
+  self->events = g_array_new (FALSE, FALSE, sizeof (RowEvent));
+  g_array_set_clear_func (self->events, row_event_clear);
+
+  if (!committed)
+    return;
+
+  for (unsigned int i = 0; i < events->len; i++)
+    {
+      RowEvent *event = &g_array_index (events, RowEvent, i);
+
+      switch (event->event)
+        {
+        case SQLITE_INSERT:
+          valent_sms_store_message_added (self, event->message);
+          break;
+
+        case SQLITE_UPDATE:
+          valent_sms_store_message_changed (self, event->message);
+          break;
+
+        case SQLITE_DELETE:
+          valent_sms_store_message_removed (self, event->message);
+          break;
+        }
+    }
+}
+
+static void
+rollback_hook (gpointer user_data)
+{
+  ValentSmsStore *self = VALENT_SMS_STORE (user_data);
+
+  g_assert (VALENT_IS_SMS_STORE (self));
+  g_assert (!VALENT_IS_MAIN_THREAD ());
+
+  valent_sms_store_flush_events (self, FALSE);
+}
+
 static void
 update_hook (gpointer       user_data,
              int            event,
@@ -298,9 +665,10 @@ update_hook (gpointer       user_data,
              sqlite3_int64  rowid)
 {
   ValentSmsStore *self = VALENT_SMS_STORE (user_data);
-  sqlite3_stmt *stmt = self->stmts[STMT_GET_MESSAGE];
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_MESSAGE_ROWID];
   g_autoptr (ValentMessage) message = NULL;
   g_autoptr (GError) error = NULL;
+  RowEvent row_event;
 
   g_assert (VALENT_IS_SMS_STORE (self));
   g_assert (!VALENT_IS_MAIN_THREAD ());
@@ -308,12 +676,14 @@ update_hook (gpointer       user_data,
   if G_UNLIKELY (g_strcmp0 (table, "message") != 0)
     return;
 
-  if (event != SQLITE_DELETE)
-    {
-      sqlite3_bind_int64 (stmt, 1, rowid);
-      message = valent_sms_store_get_message_step (stmt, &error);
-      sqlite3_reset (stmt);
-    }
+  /* The row is already gone, so removals are collected by the task that
+   * deletes them (see valent_sms_store_remove_step()) */
+  if (event == SQLITE_DELETE)
+    return;
+
+  sqlite3_bind_int64 (stmt, 1, rowid);
+  message = valent_sms_store_get_message_step (stmt, &error);
+  sqlite3_reset (stmt);
 
   if G_UNLIKELY (error != NULL)
     {
@@ -321,34 +691,37 @@ update_hook (gpointer       user_data,
       return;
     }
 
-  /* Fallback to using a message skeleton */
-  if (message == NULL)
-    {
-      message = g_object_new (VALENT_TYPE_MESSAGE,
-                              "id", rowid,
-                              NULL);
-    }
-
-  switch (event)
-    {
-    case SQLITE_INSERT:
-      valent_sms_store_message_added (self, message);
-      break;
-
-    case SQLITE_UPDATE:
-      valent_sms_store_message_changed (self, message);
-      break;
+  if G_UNLIKELY (message == NULL)
+    return;
 
-    case SQLITE_DELETE:
-      valent_sms_store_message_removed (self, message);
-      break;
-    }
+  row_event.event = event;
+  row_event.message = g_steal_pointer (&message);
+  g_array_append_val (self->events, row_event);
 }
 
 
 /*
  * ValentSmsStore Tasks
  */
+typedef struct
+{
+  GPtrArray    *messages;
+  unsigned int  position;
+} MessageBatch;
+
+static void
+message_batch_free (gpointer data)
+{
+  MessageBatch *batch = data;
+
+  g_clear_pointer (&batch->messages, g_ptr_array_unref);
+  g_free (batch);
+}
+
+static inline void   valent_sms_store_push (ValentSmsStore  *self,
+                                            GTask           *task,
+                                            GTaskThreadFunc  task_func);
+
 static void
 valent_sms_store_open_task (GTask        *task,
                             gpointer      source_object,
@@ -357,6 +730,7 @@ valent_sms_store_open_task (GTask        *task,
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
   const char *path = task_data;
+  GError *error = NULL;
   int rc;
 
   if (g_task_return_error_if_cancelled (task))
@@ -384,6 +758,25 @@ valent_sms_store_open_task (GTask        *task,
       return;
     }
 
+  /* Use write-ahead logging, which only needs to sync on checkpoints.
+   *
+   * See:
+   *   https://www.sqlite.org/wal.html
+   *   https://www.sqlite.org/pragma.html#pragma_synchronous
+   */
+  rc = sqlite3_exec (self->connection,
+                     "PRAGMA journal_mode=WAL;"
+                     "PRAGMA synchronous=NORMAL;",
+                     NULL,
+                     NULL,
+                     NULL);
+
+  if (rc != SQLITE_OK)
+    {
+      g_debug ("sqlite3_exec(): \"%s\": [%i] %s",
+               "PRAGMA journal_mode=WAL;", rc, sqlite3_errstr (rc));
+    }
+
   /* Prepare the tables */
   rc = sqlite3_exec (self->connection,
                      MESSAGE_TABLE_SQL,
@@ -402,12 +795,34 @@ valent_sms_store_open_task (GTask        *task,
       return;
     }
 
+  /* Migrate the schema */
+  if (!valent_sms_store_migrate (self, &error))
+    {
+      g_task_return_error (task, error);
+      g_clear_pointer (&self->connection, sqlite3_close);
+      return;
+    }
+
+  /* A full-text index is an optimization, so failing to create one is not
+   * fatal to the store */
+  if (!valent_sms_store_prepare_fts (self, &error))
+    {
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      g_clear_error (&error);
+
+      self->fts = FALSE;
+      valent_sms_store_exec (self, MESSAGE_FTS_DROP_SQL, NULL);
+    }
+
   /* Prepare the statements */
   for (unsigned int i = 0; i < N_STATEMENTS; i++)
     {
       sqlite3_stmt *stmt = NULL;
       const char *sql = statements[i];
 
+      if (i == STMT_FIND_MESSAGES && !self->fts)
+        sql = FIND_MESSAGES_LIKE_SQL;
+
       rc = sqlite3_prepare_v2 (self->connection, sql, -1, &stmt, NULL);
 
       if (rc != SQLITE_OK)
@@ -425,7 +840,10 @@ valent_sms_store_open_task (GTask        *task,
     }
 
   /* Connect the hooks */
+  self->events = g_array_new (FALSE, FALSE, sizeof (RowEvent));
+  g_array_set_clear_func (self->events, row_event_clear);
   sqlite3_update_hook (self->connection, update_hook, self);
+  sqlite3_rollback_hook (self->connection, rollback_hook, self);
 
   g_task_return_boolean (task, TRUE);
 }
@@ -448,6 +866,8 @@ valent_sms_store_close_task (GTask        *task,
   /* Cleanup cached statements */
   for (unsigned int i = 0; i < N_STATEMENTS; i++)
     g_clear_pointer (&self->stmts[i], sqlite3_finalize);
+  g_clear_pointer (&self->watermarks, g_hash_table_unref);
+  g_clear_pointer (&self->events, g_array_unref);
 
   /* Optimize the database before closing.
    *
@@ -485,39 +905,139 @@ add_messages_task (GTask        *task,
                    GCancellable *cancellable)
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
-  GPtrArray *messages = task_data;
+  MessageBatch *batch = task_data;
+  GPtrArray *messages = batch->messages;
   sqlite3_stmt *stmt = self->stmts[STMT_ADD_MESSAGE];
-  unsigned int n_messages = messages->len;
+  unsigned int n_messages;
   GError *error = NULL;
 
-  if (g_task_return_error_if_cancelled (task))
-    return;
+  if (g_task_return_error_if_cancelled (task) ||
+      valent_sms_store_return_error_if_closed (task, self))
+    {
+      if (batch->position > 0)
+        g_ptr_array_set_size (messages, batch->position);
+      return;
+    }
 
-  if (valent_sms_store_return_error_if_closed (task, self))
-    return;
+  /* Write each batch in a single transaction, instead of one implicit
+   * transaction (and sync) per message */
+  if (!valent_sms_store_exec (self, "BEGIN;", &error))
+    {
+      g_ptr_array_set_size (messages, batch->position);
+      return g_task_return_error (task, error);
+    }
 
-  for (unsigned int i = 0; i < n_messages; i++)
+  n_messages = MIN (batch->position + MESSAGE_BATCH_SIZE, messages->len);
+
+  for (unsigned int i = batch->position; i < n_messages; i++)
     {
       ValentMessage *message = g_ptr_array_index (messages, i);
+      unsigned int n_events = self->events->len;
 
-      /* Iterate the results stopping on error to mark the point of failure */
+      /* Iterate the results stopping on error to mark the point of failure,
+       * discarding any changes reported by the failed statement */
       if (!valent_sms_store_set_message_step (stmt, message, &error))
         {
+          g_array_set_size (self->events, n_events);
           n_messages = i;
           break;
         }
     }
 
-  /* Truncate the input on failure, since we'll be emitting signals */
-  if (n_messages < messages->len)
-    g_ptr_array_remove_range (messages, n_messages, messages->len - n_messages);
+  /* Commit any messages preceding a failure, then announce them */
+  if (valent_sms_store_exec (self, "COMMIT;", error == NULL ? &error : NULL))
+    {
+      valent_sms_store_flush_events (self, TRUE);
+    }
+  else
+    {
+      valent_sms_store_exec (self, "ROLLBACK;", NULL);
+      valent_sms_store_flush_events (self, FALSE);
+      g_clear_pointer (&self->watermarks, g_hash_table_unref);
+      n_messages = batch->position;
+    }
 
+  for (unsigned int i = batch->position; i < n_messages; i++)
+    {
+      ValentMessage *message = g_ptr_array_index (messages, i);
+
+      valent_sms_store_update_watermark (self,
+                                         valent_message_get_thread_id (message),
+                                         valent_message_get_date (message));
+    }
+
+  batch->position = n_messages;
+
+  /* Truncate the input on failure, since we'll be emitting signals */
   if (error != NULL)
-    return g_task_return_error (task, error);
+    {
+      g_ptr_array_set_size (messages, batch->position);
+      return g_task_return_error (task, error);
+    }
+
+  /* Requeue the remaining messages, so that other tasks are not blocked for
+   * the duration of a large import */
+  if (batch->position < messages->len)
+    return valent_sms_store_push (self, task, add_messages_task);
 
   g_task_return_boolean (task, TRUE);
 }
 
+/*
+ * Delete the rows matching @key with @remove_stmt, after collecting them with
+ * @select_stmt. The update hook is only passed the rowid of a deleted row, so
+ * this is how removals are announced with the complete message.
+ */
+static gboolean
+valent_sms_store_remove_step (ValentSmsStore  *self,
+                              sqlite3_stmt    *select_stmt,
+                              sqlite3_stmt    *remove_stmt,
+                              int64_t          key,
+                              GError         **error)
+{
+  g_autoptr (GPtrArray) removed = NULL;
+  ValentMessage *message;
+  int rc;
+
+  removed = g_ptr_array_new_with_free_func (g_object_unref);
+  sqlite3_bind_int64 (select_stmt, 1, key);
+
+  while ((message = valent_sms_store_get_message_step (select_stmt, error)))
+    g_ptr_array_add (removed, message);
+  sqlite3_reset (select_stmt);
+
+  if (error != NULL && *error != NULL)
+    return FALSE;
+
+  sqlite3_bind_int64 (remove_stmt, 1, key);
+  rc = sqlite3_step (remove_stmt);
+  sqlite3_reset (remove_stmt);
+
+  if (rc != SQLITE_DONE && rc != SQLITE_OK)
+    {
+      valent_sms_store_flush_events (self, FALSE);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "%s: %s",
+                   G_STRFUNC, sqlite3_errstr (rc));
+      return FALSE;
+    }
+
+  for (unsigned int i = 0; i < removed->len; i++)
+    {
+      RowEvent row_event;
+
+      row_event.event = SQLITE_DELETE;
+      row_event.message = g_object_ref (g_ptr_array_index (removed, i));
+      g_array_append_val (self->events, row_event);
+    }
+
+  valent_sms_store_flush_events (self, TRUE);
+
+  return TRUE;
+}
+
 static void
 remove_message_task (GTask        *task,
                      gpointer      source_object,
@@ -526,8 +1046,8 @@ remove_message_task (GTask        *task,
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
   int64_t *message_id = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_REMOVE_MESSAGE];
-  int rc;
+  gboolean ret;
+  GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -535,18 +1055,19 @@ remove_message_task (GTask        *task,
   if (valent_sms_store_return_error_if_closed (task, self))
     return;
 
-  sqlite3_bind_int64 (stmt, 1, *message_id);
-  rc = sqlite3_step (stmt);
-  sqlite3_reset (stmt);
+  ret = valent_sms_store_remove_step (self,
+                                      self->stmts[STMT_GET_MESSAGE],
+                                      self->stmts[STMT_REMOVE_MESSAGE],
+                                      *message_id,
+                                      &error);
 
-  if (rc == SQLITE_DONE || rc == SQLITE_OK)
-    return g_task_return_boolean (task, TRUE);
+  /* The message ID is not unique across threads, so reload the watermarks */
+  g_clear_pointer (&self->watermarks, g_hash_table_unref);
+
+  if (!ret)
+    return g_task_return_error (task, error);
 
-  return g_task_return_new_error (task,
-                                  G_IO_ERROR,
-                                  G_IO_ERROR_FAILED,
-                                  "%s: %s",
-                                  G_STRFUNC, sqlite3_errstr (rc));
+  g_task_return_boolean (task, TRUE);
 }
 
 static void
@@ -557,8 +1078,8 @@ remove_thread_task (GTask        *task,
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
   int64_t *thread_id = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_REMOVE_THREAD];
-  int rc;
+  gboolean ret;
+  GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -566,18 +1087,19 @@ remove_thread_task (GTask        *task,
   if (valent_sms_store_return_error_if_closed (task, self))
     return;
 
-  sqlite3_bind_int64 (stmt, 1, *thread_id);
-  rc = sqlite3_step (stmt);
-  sqlite3_reset (stmt);
+  ret = valent_sms_store_remove_step (self,
+                                      self->stmts[STMT_GET_THREAD],
+                                      self->stmts[STMT_REMOVE_THREAD],
+                                      *thread_id,
+                                      &error);
 
-  if (rc == SQLITE_DONE || rc == SQLITE_OK)
-    return g_task_return_boolean (task, TRUE);
+  if (self->watermarks != NULL)
+    g_hash_table_remove (self->watermarks, thread_id);
+
+  if (!ret)
+    return g_task_return_error (task, error);
 
-  return g_task_return_new_error (task,
-                                  G_IO_ERROR,
-                                  G_IO_ERROR_FAILED,
-                                  "%s: %s",
-                                  G_STRFUNC, sqlite3_errstr (rc));
+  g_task_return_boolean (task, TRUE);
 }
 
 static void
@@ -600,13 +1122,25 @@ find_messages_task (GTask        *task,
   if (valent_sms_store_return_error_if_closed (task, self))
     return;
 
-  // NOTE: escaped percent signs (%%) are query wildcards (%)
-  query_param = g_strdup_printf ("%%%s%%", query);
-  sqlite3_bind_text (stmt, 1, query_param, -1, NULL);
-
   /* Collect the results */
   messages = g_ptr_array_new_with_free_func (g_object_unref);
 
+  // NOTE: escaped percent signs (%%) are query wildcards (%)
+  if (!self->fts)
+    query_param = g_strdup_printf ("%%%s%%", query);
+  else
+    query_param = valent_sms_store_fts_query (query);
+
+  if (query_param == NULL)
+    {
+      g_task_return_pointer (task,
+                             g_steal_pointer (&messages),
+                             (GDestroyNotify)g_ptr_array_unref);
+      return;
+    }
+
+  sqlite3_bind_text (stmt, 1, query_param, -1, NULL);
+
   while ((message = valent_sms_store_get_message_step (stmt, &error)))
     g_ptr_array_add (messages, message);
   sqlite3_reset (stmt);
@@ -705,9 +1239,8 @@ get_thread_date_task (GTask        *task,
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
   int64_t *thread_id = task_data;
-  sqlite3_stmt *stmt = self->stmts[STMT_GET_THREAD_DATE];
   int64_t date = 0;
-  int rc;
+  GError *error = NULL;
 
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -715,24 +1248,44 @@ get_thread_date_task (GTask        *task,
   if (valent_sms_store_return_error_if_closed (task, self))
     return;
 
-  sqlite3_bind_int64 (stmt, 1, *thread_id);
+  if (!valent_sms_store_get_watermark (self, *thread_id, &date, &error))
+    return g_task_return_error (task, error);
 
-  if ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
-    date = sqlite3_column_int64 (stmt, 0);
+  g_task_return_int (task, date);
+}
 
-  sqlite3_reset (stmt);
+static void
+get_thread_dates_task (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  ValentSmsStore *self = VALENT_SMS_STORE (source_object);
+  GArray *thread_ids = task_data;
+  g_autoptr (GArray) dates = NULL;
+  GError *error = NULL;
 
-  if (rc != SQLITE_DONE && rc != SQLITE_ROW)
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if (valent_sms_store_return_error_if_closed (task, self))
+    return;
+
+  dates = g_array_sized_new (FALSE, TRUE, sizeof (int64_t), thread_ids->len);
+  g_array_set_size (dates, thread_ids->len);
+
+  for (unsigned int i = 0; i < thread_ids->len; i++)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_FAILED,
-                               "%s: %s",
-                               G_STRFUNC, sqlite3_errstr (rc));
-      return;
+      if (!valent_sms_store_get_watermark (self,
+                                           g_array_index (thread_ids, int64_t, i),
+                                           &g_array_index (dates, int64_t, i),
+                                           &error))
+        return g_task_return_error (task, error);
     }
 
-  g_task_return_int (task, date);
+  g_task_return_pointer (task,
+                         g_steal_pointer (&dates),
+                         (GDestroyNotify)g_array_unref);
 }
 
 static void
@@ -786,6 +1339,98 @@ get_thread_items_task (GTask        *task,
                          (GDestroyNotify)g_ptr_array_unref);
 }
 
+static void
+get_thread_range_task (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  ValentSmsStore *self = VALENT_SMS_STORE (source_object);
+  int64_t *range = task_data;
+  sqlite3_stmt *stmt = self->stmts[STMT_GET_THREAD_RANGE];
+  g_autoptr (GPtrArray) messages = NULL;
+  ValentMessage *message;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if (valent_sms_store_return_error_if_closed (task, self))
+    return;
+
+  messages = g_ptr_array_new_with_free_func (g_object_unref);
+  sqlite3_bind_int64 (stmt, 1, range[0]);
+  sqlite3_bind_int64 (stmt, 2, range[1]);
+  sqlite3_bind_int64 (stmt, 3, range[2]);
+
+  while ((message = valent_sms_store_get_message_step (stmt, &error)))
+    g_ptr_array_add (messages, message);
+  sqlite3_reset (stmt);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  g_task_return_pointer (task,
+                         g_steal_pointer (&messages),
+                         (GDestroyNotify)g_ptr_array_unref);
+}
+
+
+/*
+ * Message Cache
+ *
+ * Message IDs are only unique within a thread, so cached messages are keyed
+ * by the pair of thread ID and message ID.
+ */
+typedef struct
+{
+  int64_t  thread_id;
+  int64_t  id;
+} MessageKey;
+
+static guint
+message_key_hash (gconstpointer data)
+{
+  const MessageKey *key = data;
+
+  return g_int64_hash (&key->thread_id) ^ g_int64_hash (&key->id);
+}
+
+static gboolean
+message_key_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  const MessageKey *key1 = a;
+  const MessageKey *key2 = b;
+
+  return key1->thread_id == key2->thread_id && key1->id == key2->id;
+}
+
+static inline MessageKey
+message_key_init (ValentMessage *message)
+{
+  return (MessageKey){
+    .thread_id = valent_message_get_thread_id (message),
+    .id = valent_message_get_id (message),
+  };
+}
+
+static void
+on_message_invalidated (ValentSmsStore *self,
+                        ValentMessage  *message,
+                        gpointer        user_data)
+{
+  MessageKey key = message_key_init (message);
+  GList *link;
+
+  if ((link = g_hash_table_lookup (self->cache, &key)) == NULL)
+    return;
+
+  g_hash_table_remove (self->cache, &key);
+  g_object_unref (link->data);
+  g_queue_delete_link (&self->cache_queue, link);
+}
+
 
 /*
  * Private
@@ -902,6 +1547,9 @@ valent_sms_store_finalize (GObject *object)
   g_clear_pointer (&self->queue, g_async_queue_unref);
   g_clear_pointer (&self->path, g_free);
   g_clear_weak_pointer (&self->summary);
+  g_clear_pointer (&self->watermarks, g_hash_table_unref);
+  g_clear_pointer (&self->cache, g_hash_table_unref);
+  g_queue_clear_full (&self->cache_queue, g_object_unref);
 
   G_OBJECT_CLASS (valent_sms_store_parent_class)->finalize (object);
 }
@@ -980,9 +1628,12 @@ valent_sms_store_class_init (ValentSmsStoreClass *klass)
   statements[STMT_REMOVE_MESSAGE] = REMOVE_MESSAGE_SQL;
   statements[STMT_REMOVE_THREAD] = REMOVE_THREAD_SQL;
   statements[STMT_GET_MESSAGE] = GET_MESSAGE_SQL;
+  statements[STMT_GET_MESSAGE_ROWID] = GET_MESSAGE_ROWID_SQL;
   statements[STMT_GET_THREAD] = GET_THREAD_SQL;
   statements[STMT_GET_THREAD_DATE] = GET_THREAD_DATE_SQL;
+  statements[STMT_GET_THREAD_DATES] = GET_THREAD_DATES_SQL;
   statements[STMT_GET_THREAD_ITEMS] = GET_THREAD_ITEMS_SQL;
+  statements[STMT_GET_THREAD_RANGE] = GET_THREAD_RANGE_SQL;
   statements[STMT_FIND_MESSAGES] = FIND_MESSAGES_SQL;
   statements[STMT_GET_SUMMARY] = GET_SUMMARY_SQL;
 }
@@ -991,6 +1642,18 @@ static void
 valent_sms_store_init (ValentSmsStore *self)
 {
   self->queue = g_async_queue_new_full (task_closure_cancel);
+  self->cache = g_hash_table_new_full (message_key_hash, message_key_equal,
+                                       g_free, NULL);
+  g_queue_init (&self->cache_queue);
+
+  g_signal_connect (self,
+                    "message-changed",
+                    G_CALLBACK (on_message_invalidated),
+                    NULL);
+  g_signal_connect (self,
+                    "message-removed",
+                    G_CALLBACK (on_message_invalidated),
+                    NULL);
 }
 
 /**
@@ -1030,6 +1693,7 @@ valent_sms_store_add_message (ValentSmsStore      *store,
 {
   g_autoptr (GTask) task = NULL;
   g_autoptr (GPtrArray) messages = NULL;
+  MessageBatch *batch;
 
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (VALENT_IS_MESSAGE (message));
@@ -1037,11 +1701,12 @@ valent_sms_store_add_message (ValentSmsStore      *store,
   messages = g_ptr_array_new_with_free_func (g_object_unref);
   g_ptr_array_add (messages, g_object_ref (message));
 
+  batch = g_new0 (MessageBatch, 1);
+  batch->messages = g_steal_pointer (&messages);
+
   task = g_task_new (store, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_sms_store_add_message);
-  g_task_set_task_data (task,
-                        g_steal_pointer (&messages),
-                        (GDestroyNotify)g_ptr_array_unref);
+  g_task_set_task_data (task, batch, message_batch_free);
   valent_sms_store_push (store, task, add_messages_task);
 }
 
@@ -1063,15 +1728,17 @@ valent_sms_store_add_messages (ValentSmsStore      *store,
                                gpointer             user_data)
 {
   g_autoptr (GTask) task = NULL;
+  MessageBatch *batch;
 
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (messages != NULL);
 
+  batch = g_new0 (MessageBatch, 1);
+  batch->messages = g_ptr_array_ref (messages);
+
   task = g_task_new (store, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_sms_store_add_message);
-  g_task_set_task_data (task,
-                        g_ptr_array_ref (messages),
-                        (GDestroyNotify)g_ptr_array_unref);
+  g_task_set_task_data (task, batch, message_batch_free);
   valent_sms_store_push (store, task, add_messages_task);
 }
 
@@ -1398,6 +2065,66 @@ valent_sms_store_get_thread_date (ValentSmsStore *store,
   return date;
 }
 
+/**
+ * valent_sms_store_get_thread_dates:
+ * @store: a #ValentSmsStore
+ * @thread_ids: (element-type int64_t): an array of thread IDs
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Get the date of the last message in each thread of @thread_ids.
+ *
+ * Unlike valent_sms_store_get_thread_date(), this does not block and the
+ * dates for all threads are looked up in a single task.
+ */
+void
+valent_sms_store_get_thread_dates (ValentSmsStore      *store,
+                                   GArray              *thread_ids,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (VALENT_IS_SMS_STORE (store));
+  g_return_if_fail (thread_ids != NULL);
+  g_return_if_fail (g_array_get_element_size (thread_ids) == sizeof (int64_t));
+
+  task = g_task_new (store, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_sms_store_get_thread_dates);
+  g_task_set_task_data (task,
+                        g_array_ref (thread_ids),
+                        (GDestroyNotify)g_array_unref);
+  valent_sms_store_push (store, task, get_thread_dates_task);
+}
+
+/**
+ * valent_sms_store_get_thread_dates_finish:
+ * @store: a #ValentSmsStore
+ * @result: a #GAsyncResult
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by valent_sms_store_get_thread_dates().
+ *
+ * The result holds a UNIX epoch timestamp for each thread ID, in the same
+ * order, or `0` if there are no messages in the thread.
+ *
+ * Returns: (transfer full) (element-type int64_t): an array of dates,
+ *   or %NULL with @error set
+ */
+GArray *
+valent_sms_store_get_thread_dates_finish (ValentSmsStore  *store,
+                                          GAsyncResult    *result,
+                                          GError         **error)
+{
+  g_return_val_if_fail (VALENT_IS_SMS_STORE (store), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, store), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 /**
  * valent_sms_store_get_thread_items:
  * @store: a #ValentSmsStore
@@ -1428,6 +2155,127 @@ valent_sms_store_get_thread_items (ValentSmsStore      *store,
   valent_sms_store_push (store, task, get_thread_items_task);
 }
 
+/**
+ * valent_sms_store_get_thread_range:
+ * @store: a #ValentSmsStore
+ * @thread_id: a thread ID
+ * @start_date: the date of the first message
+ * @end_date: the date of the last message
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Get the messages in @thread_id dated from @start_date to @end_date
+ * (inclusive), ascending by date.
+ *
+ * Call g_task_propagate_pointer() to get the result, a #GPtrArray of
+ * #ValentMessage objects.
+ */
+void
+valent_sms_store_get_thread_range (ValentSmsStore      *store,
+                                   int64_t              thread_id,
+                                   int64_t              start_date,
+                                   int64_t              end_date,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  int64_t *task_data;
+
+  g_return_if_fail (VALENT_IS_SMS_STORE (store));
+  g_return_if_fail (thread_id >= 0);
+  g_return_if_fail (start_date <= end_date);
+
+  task_data = g_new0 (int64_t, 3);
+  task_data[0] = thread_id;
+  task_data[1] = start_date;
+  task_data[2] = end_date;
+
+  task = g_task_new (store, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_sms_store_get_thread_range);
+  g_task_set_task_data (task, task_data, g_free);
+  valent_sms_store_push (store, task, get_thread_range_task);
+}
+
+/**
+ * valent_sms_store_cache_message:
+ * @store: a #ValentSmsStore
+ * @message: a #ValentMessage
+ *
+ * Add the hydrated @message to the cache of @store, evicting the least
+ * recently used message if the cache is full.
+ *
+ * This function must be called from the main thread.
+ */
+void
+valent_sms_store_cache_message (ValentSmsStore *store,
+                                ValentMessage  *message)
+{
+  MessageKey key;
+  GList *link;
+
+  g_return_if_fail (VALENT_IS_SMS_STORE (store));
+  g_return_if_fail (VALENT_IS_MESSAGE (message));
+  g_return_if_fail (VALENT_IS_MAIN_THREAD ());
+
+  key = message_key_init (message);
+
+  if ((link = g_hash_table_lookup (store->cache, &key)) != NULL)
+    {
+      g_hash_table_remove (store->cache, &key);
+      g_object_unref (link->data);
+      g_queue_delete_link (&store->cache_queue, link);
+    }
+
+  g_queue_push_head (&store->cache_queue, g_object_ref (message));
+  g_hash_table_insert (store->cache,
+                       g_memdup2 (&key, sizeof (MessageKey)),
+                       store->cache_queue.head);
+
+  if (store->cache_queue.length > MESSAGE_CACHE_SIZE)
+    {
+      ValentMessage *last = g_queue_pop_tail (&store->cache_queue);
+
+      key = message_key_init (last);
+      g_hash_table_remove (store->cache, &key);
+      g_object_unref (last);
+    }
+}
+
+/**
+ * valent_sms_store_lookup_message:
+ * @store: a #ValentSmsStore
+ * @thread_id: a thread ID
+ * @message_id: a message ID
+ *
+ * Get the cached message for @message_id in @thread_id, marking it as recently
+ * used.
+ *
+ * This function must be called from the main thread.
+ *
+ * Returns: (transfer full) (nullable): a #ValentMessage
+ */
+ValentMessage *
+valent_sms_store_lookup_message (ValentSmsStore *store,
+                                 int64_t         thread_id,
+                                 int64_t         message_id)
+{
+  MessageKey key = { thread_id, message_id };
+  GList *link;
+
+  g_return_val_if_fail (VALENT_IS_SMS_STORE (store), NULL);
+  g_return_val_if_fail (VALENT_IS_MAIN_THREAD (), NULL);
+
+  if ((link = g_hash_table_lookup (store->cache, &key)) == NULL)
+    return NULL;
+
+  g_queue_unlink (&store->cache_queue, link);
+  g_queue_push_head_link (&store->cache_queue, link);
+
+  return g_object_ref (link->data);
+}
+
 /**
  * valent_sms_store_message_added:
  * @store: a #ValentSmsStore
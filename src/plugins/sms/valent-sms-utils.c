@@ -139,6 +139,300 @@ valent_sms_avatar_from_contact (AdwAvatar *avatar,
   adw_avatar_set_show_initials (avatar, paintable != NULL);
 }
 
+/*
+ * Phone Number Index
+ *
+ * A map of normalized phone numbers to contacts, attached to a
+ * ValentContactStore and kept current by its signals. Numbers are bucketed by
+ * their trailing digits, so that the suffix comparison used by
+ * valent_phone_number_equal() is only done against the few candidates in a
+ * bucket. Numbers shorter than the key are bucketed by the whole number, so a
+ * longer number is also checked against the buckets for each of its shorter
+ * suffixes.
+ */
+#define PHONE_INDEX_KEY_LENGTH (7)
+
+static GQuark phone_index_quark = 0;
+
+typedef struct
+{
+  GHashTable   *contacts;
+  GHashTable   *numbers;
+  GCancellable *cancellable;
+  gboolean      loaded;
+} PhoneIndex;
+
+static inline const char *
+phone_index_key (const char *normalized)
+{
+  size_t len = strlen (normalized);
+
+  if (len > PHONE_INDEX_KEY_LENGTH)
+    return normalized + len - PHONE_INDEX_KEY_LENGTH;
+
+  return normalized;
+}
+
+static void
+phone_index_free (gpointer data)
+{
+  PhoneIndex *index = data;
+
+  g_cancellable_cancel (index->cancellable);
+  g_clear_object (&index->cancellable);
+  g_clear_pointer (&index->numbers, g_hash_table_unref);
+  g_clear_pointer (&index->contacts, g_hash_table_unref);
+  g_free (index);
+}
+
+static void
+phone_index_remove (PhoneIndex *index,
+                    const char *uid)
+{
+  EContact *contact;
+  GList *numbers;
+
+  if ((contact = g_hash_table_lookup (index->contacts, uid)) == NULL)
+    return;
+
+  numbers = e_contact_get (contact, E_CONTACT_TEL);
+
+  for (const GList *iter = numbers; iter; iter = iter->next)
+    {
+      g_autofree char *normalized = NULL;
+      GPtrArray *bucket;
+
+      normalized = valent_phone_number_normalize (iter->data);
+      bucket = g_hash_table_lookup (index->numbers, phone_index_key (normalized));
+
+      if (bucket == NULL)
+        continue;
+
+      while (g_ptr_array_remove_fast (bucket, contact))
+        continue;
+
+      if (bucket->len == 0)
+        g_hash_table_remove (index->numbers, phone_index_key (normalized));
+    }
+  g_list_free_full (numbers, g_free);
+
+  g_hash_table_remove (index->contacts, uid);
+}
+
+static void
+phone_index_add (PhoneIndex *index,
+                 EContact   *contact)
+{
+  const char *uid;
+  GList *numbers;
+
+  if ((uid = e_contact_get_const (contact, E_CONTACT_UID)) == NULL)
+    return;
+
+  phone_index_remove (index, uid);
+
+  numbers = e_contact_get (contact, E_CONTACT_TEL);
+
+  if (numbers == NULL)
+    return;
+
+  g_hash_table_replace (index->contacts, g_strdup (uid), g_object_ref (contact));
+
+  for (const GList *iter = numbers; iter; iter = iter->next)
+    {
+      g_autofree char *normalized = NULL;
+      GPtrArray *bucket;
+      const char *key;
+
+      normalized = valent_phone_number_normalize (iter->data);
+      key = phone_index_key (normalized);
+
+      if ((bucket = g_hash_table_lookup (index->numbers, key)) == NULL)
+        {
+          bucket = g_ptr_array_new ();
+          g_hash_table_replace (index->numbers, g_strdup (key), bucket);
+        }
+
+      if (!g_ptr_array_find (bucket, contact, NULL))
+        g_ptr_array_add (bucket, contact);
+    }
+  g_list_free_full (numbers, g_free);
+}
+
+static void
+on_contact_added (ValentContactStore *store,
+                  EContact           *contact,
+                  PhoneIndex         *index)
+{
+  phone_index_add (index, contact);
+}
+
+static void
+on_contact_removed (ValentContactStore *store,
+                    const char         *uid,
+                    PhoneIndex         *index)
+{
+  phone_index_remove (index, uid);
+}
+
+static void
+phone_index_load_cb (ValentContactStore *store,
+                     GAsyncResult       *result,
+                     gpointer            user_data)
+{
+  PhoneIndex *index = NULL;
+  g_autoslist (GObject) contacts = NULL;
+  g_autoptr (GError) error = NULL;
+
+  contacts = valent_contact_store_query_finish (store, result, &error);
+
+  if (error != NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      return;
+    }
+
+  /* Contacts added since the query started take precedence */
+  index = g_object_get_qdata (G_OBJECT (store), phone_index_quark);
+
+  for (const GSList *iter = contacts; iter; iter = iter->next)
+    {
+      const char *uid = e_contact_get_const (iter->data, E_CONTACT_UID);
+
+      if (uid != NULL && !g_hash_table_contains (index->contacts, uid))
+        phone_index_add (index, iter->data);
+    }
+
+  index->loaded = TRUE;
+}
+
+static PhoneIndex *
+phone_index_ensure (ValentContactStore *store)
+{
+  PhoneIndex *index = NULL;
+  g_autoptr (EBookQuery) query = NULL;
+  g_autofree char *sexp = NULL;
+
+  if G_UNLIKELY (phone_index_quark == 0)
+    phone_index_quark = g_quark_from_static_string ("valent-sms-phone-index");
+
+  index = g_object_get_qdata (G_OBJECT (store), phone_index_quark);
+
+  if (index != NULL)
+    return index;
+
+  index = g_new0 (PhoneIndex, 1);
+  index->contacts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, g_object_unref);
+  index->numbers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, (GDestroyNotify)g_ptr_array_unref);
+  index->cancellable = g_cancellable_new ();
+  g_object_set_qdata_full (G_OBJECT (store),
+                           phone_index_quark,
+                           index,
+                           phone_index_free);
+
+  /* The index is freed with the store, so the handlers need no disconnect */
+  g_signal_connect (store,
+                    "contact-added",
+                    G_CALLBACK (on_contact_added),
+                    index);
+  g_signal_connect (store,
+                    "contact-removed",
+                    G_CALLBACK (on_contact_removed),
+                    index);
+
+  query = e_book_query_field_exists (E_CONTACT_TEL);
+  sexp = e_book_query_to_string (query);
+  valent_contact_store_query (store,
+                              sexp,
+                              index->cancellable,
+                              (GAsyncReadyCallback)phone_index_load_cb,
+                              NULL);
+
+  return index;
+}
+
+static inline gboolean
+valent_sms_contact_index_ready (ValentContactStore *store)
+{
+  return phone_index_ensure (store)->loaded;
+}
+
+/**
+ * valent_sms_contact_lookup_phone:
+ * @store: a #ValentContactStore
+ * @number: a phone number
+ *
+ * Look up the contact in @store with the phone number @number.
+ *
+ * The index of phone numbers for @store is built asynchronously on first use
+ * and updated as contacts are added and removed. Until it is ready, this
+ * function returns %NULL.
+ *
+ * Returns: (transfer none) (nullable): an #EContact
+ */
+EContact *
+valent_sms_contact_lookup_phone (ValentContactStore *store,
+                                 const char         *number)
+{
+  PhoneIndex *index = NULL;
+  g_autofree char *normalized = NULL;
+  size_t len;
+
+  g_return_val_if_fail (VALENT_IS_CONTACT_STORE (store), NULL);
+  g_return_val_if_fail (number != NULL && *number != '\0', NULL);
+
+  index = phone_index_ensure (store);
+
+  if (!index->loaded)
+    return NULL;
+
+  normalized = valent_phone_number_normalize (number);
+  len = strlen (normalized);
+
+  /* Short numbers can only be matched by a scan */
+  if (len < PHONE_INDEX_KEY_LENGTH)
+    {
+      GHashTableIter iter;
+      EContact *contact;
+
+      g_hash_table_iter_init (&iter, index->contacts);
+
+      while (g_hash_table_iter_next (&iter, NULL, (void **)&contact))
+        {
+          if (valent_phone_number_of_contact (contact, normalized))
+            return contact;
+        }
+
+      return NULL;
+    }
+
+  /* Check the bucket for the full key, then any for shorter stored numbers.
+   * A bucket only shares trailing digits, so each candidate is verified. */
+  for (size_t key_len = PHONE_INDEX_KEY_LENGTH; key_len > 0; key_len--)
+    {
+      GPtrArray *bucket;
+
+      bucket = g_hash_table_lookup (index->numbers, normalized + len - key_len);
+
+      if (bucket == NULL)
+        continue;
+
+      for (unsigned int i = 0; i < bucket->len; i++)
+        {
+          EContact *contact = g_ptr_array_index (bucket, i);
+
+          if (valent_phone_number_of_contact (contact, normalized))
+            return contact;
+        }
+    }
+
+  return NULL;
+}
+
 static void
 valent_sms_contact_from_phone_cb (ValentContactStore *store,
                                   GAsyncResult       *result,
@@ -210,6 +504,7 @@ valent_sms_contact_from_phone (ValentContactStore  *store,
   g_autoptr (GTask) task = NULL;
   g_autoptr (EBookQuery) query = NULL;
   g_autofree char *sexp = NULL;
+  EContact *contact = NULL;
 
   g_return_if_fail (VALENT_IS_CONTACT_STORE (store));
   g_return_if_fail (number != NULL && *number != '\0');
@@ -219,6 +514,23 @@ valent_sms_contact_from_phone (ValentContactStore  *store,
   g_task_set_source_tag (task, valent_sms_contact_from_phone);
   g_task_set_task_data (task, g_strdup (number), g_free);
 
+  /* Prefer the phone number index, once it's ready. Without libphonenumber
+   * the index is authoritative, so a miss doesn't need a query either. */
+  if ((contact = valent_sms_contact_lookup_phone (store, number)) != NULL)
+    {
+      g_task_return_pointer (task, g_object_ref (contact), g_object_unref);
+      return;
+    }
+
+  if (!e_phone_number_is_supported () && valent_sms_contact_index_ready (store))
+    {
+      contact = e_contact_new ();
+      e_contact_set (contact, E_CONTACT_FULL_NAME, number);
+      e_contact_set (contact, E_CONTACT_PHONE_OTHER, number);
+      g_task_return_pointer (task, contact, g_object_unref);
+      return;
+    }
+
   /* Prefer using libphonenumber */
   if (e_phone_number_is_supported ())
     {
@@ -19,6 +19,8 @@ void       valent_sms_contact_from_phone        (ValentContactStore   *store,
 EContact * valent_sms_contact_from_phone_finish (ValentContactStore   *store,
                                                  GAsyncResult         *result,
                                                  GError              **error);
+EContact * valent_sms_contact_lookup_phone      (ValentContactStore   *store,
+                                                 const char           *number);
 
 gboolean   valent_phone_number_equal            (const char            *number1,
                                                  const char            *number2);
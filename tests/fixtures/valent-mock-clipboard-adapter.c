@@ -18,6 +18,7 @@ struct _ValentMockClipboardAdapter
   GBytes                 *content;
   GStrv                   mimetypes;
   int64_t                 timestamp;
+  unsigned int            n_reads;
 };
 
 G_DEFINE_FINAL_TYPE (ValentMockClipboardAdapter, valent_mock_clipboard_adapter, VALENT_TYPE_CLIPBOARD_ADAPTER)
@@ -60,6 +61,8 @@ valent_mock_clipboard_adapter_read_bytes (ValentClipboardAdapter *adapter,
   g_assert (mimetype != NULL && *mimetype != '\0');
   g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
+  self->n_reads++;
+
   if (self->content == NULL)
     {
       g_task_report_new_error (adapter, callback, user_data,
@@ -145,3 +148,19 @@ valent_mock_clipboard_adapter_init (ValentMockClipboardAdapter *self)
   self->mimetypes = g_strdupv ((char *[]){"text/plain;charset=utf-8", NULL});
 }
 
+/**
+ * valent_mock_clipboard_adapter_get_n_reads:
+ * @self: a #ValentMockClipboardAdapter
+ *
+ * Get the number of times the adapter content has been read.
+ *
+ * Returns: the number of reads
+ */
+unsigned int
+valent_mock_clipboard_adapter_get_n_reads (ValentMockClipboardAdapter *self)
+{
+  g_return_val_if_fail (VALENT_IS_MOCK_CLIPBOARD_ADAPTER (self), 0);
+
+  return self->n_reads;
+}
+
@@ -11,5 +11,7 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (ValentMockClipboardAdapter, valent_mock_clipboard_adapter, VALENT, MOCK_CLIPBOARD_ADAPTER, ValentClipboardAdapter)
 
+unsigned int   valent_mock_clipboard_adapter_get_n_reads (ValentMockClipboardAdapter *self);
+
 G_END_DECLS
 
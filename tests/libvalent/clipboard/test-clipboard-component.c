@@ -5,6 +5,8 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-mock-clipboard-adapter.h"
+
 
 typedef struct
 {
@@ -107,6 +109,34 @@ valent_clipboard_read_text_cb (ValentClipboard           *clipboard,
   g_main_loop_quit (fixture->loop);
 }
 
+static void
+valent_clipboard_read_text_shared_cb (ValentClipboard *clipboard,
+                                      GAsyncResult    *result,
+                                      GPtrArray       *results)
+{
+  GError *error = NULL;
+
+  g_ptr_array_add (results,
+                   valent_clipboard_read_text_finish (clipboard, result, &error));
+  g_assert_no_error (error);
+}
+
+static void
+valent_clipboard_read_text_cancelled_cb (ValentClipboard *clipboard,
+                                         GAsyncResult    *result,
+                                         gboolean        *done)
+{
+  g_autofree char *text = NULL;
+  GError *error = NULL;
+
+  text = valent_clipboard_read_text_finish (clipboard, result, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (text);
+  g_clear_error (&error);
+
+  *done = TRUE;
+}
+
 static void
 valent_clipboard_write_text_cb (ValentClipboard           *clipboard,
                                 GAsyncResult              *result,
@@ -195,6 +225,10 @@ test_clipboard_component_self (ClipboardComponentFixture *fixture,
   g_autoptr (GBytes) bytes = NULL;
   g_autofree char *text = NULL;
   g_auto (GStrv) mimetypes = NULL;
+  g_autoptr (GPtrArray) results = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  unsigned int n_reads = 0;
+  gboolean cancelled = FALSE;
   int64_t timestamp = 0;
 
   /* Data can be written */
@@ -252,6 +286,47 @@ test_clipboard_component_self (ClipboardComponentFixture *fixture,
 
   g_assert_cmpstr (fixture->data, ==, text);
   g_clear_pointer (&fixture->data, g_free);
+
+  g_clear_pointer (&text, g_free);
+
+  /* Concurrent reads share a single adapter read, after a fresh change */
+  text = g_uuid_string_random ();
+  valent_clipboard_write_text (fixture->clipboard,
+                               text,
+                               NULL,
+                               (GAsyncReadyCallback)valent_clipboard_write_text_cb,
+                               fixture);
+  g_main_loop_run (fixture->loop);
+
+  n_reads = valent_mock_clipboard_adapter_get_n_reads (VALENT_MOCK_CLIPBOARD_ADAPTER (fixture->adapter));
+  results = g_ptr_array_new_with_free_func (g_free);
+  cancellable = g_cancellable_new ();
+
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      valent_clipboard_read_text (fixture->clipboard,
+                                  NULL,
+                                  (GAsyncReadyCallback)valent_clipboard_read_text_shared_cb,
+                                  results);
+    }
+
+  /* A cancelled caller completes without affecting the others */
+  valent_clipboard_read_text (fixture->clipboard,
+                              cancellable,
+                              (GAsyncReadyCallback)valent_clipboard_read_text_cancelled_cb,
+                              &cancelled);
+  g_cancellable_cancel (cancellable);
+
+  while (results->len < 3 || !cancelled)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (valent_mock_clipboard_adapter_get_n_reads (VALENT_MOCK_CLIPBOARD_ADAPTER (fixture->adapter)),
+                    ==,
+                    n_reads + 1);
+
+  for (unsigned int i = 0; i < results->len; i++)
+    g_assert_cmpstr (g_ptr_array_index (results, i), ==, text);
+  g_clear_pointer (&results, g_ptr_array_unref);
   g_clear_pointer (&text, g_free);
 
   /* Timestamp is updated */
@@ -28,6 +28,14 @@ static const char vcard[] =
  "TEL;CELL:123-456-7890\n"
  "END:VCARD\n";
 
+static const char vcard_photo[] =
+ "BEGIN:VCARD\n"
+ "VERSION:3.0\n"
+ "FN:Photo Contact\n"
+ "PHOTO;ENCODING=b;TYPE=PNG:iVBORw0KGgo=\n"
+ "TEL;TYPE=CELL:555-0100\n"
+ "END:VCARD\n";
+
 
 static void
 on_items_changed (GListModel               *list,
@@ -212,6 +220,9 @@ test_contacts_component_store (ContactsComponentFixture *fixture,
   g_autofree char *sexp = NULL;
   EContact *contact = NULL;
   g_autoslist (EContact) contacts = NULL;
+  g_autoptr (EContact) photo_contact = NULL;
+  static const char * const fields[] = { EVC_FN, NULL };
+  static const char * const photo_fields[] = { EVC_TEL, NULL };
 
   VALENT_TEST_CHECK ("GObject properties function correctly");
   g_object_get (fixture->store,
@@ -305,6 +316,75 @@ test_contacts_component_store (ContactsComponentFixture *fixture,
   contacts = NULL;
   g_clear_object (&contact);
 
+  /* Contacts can be queried for a subset of their fields */
+  query = e_book_query_field_exists (E_CONTACT_TEL);
+  sexp = e_book_query_to_string (query);
+
+  valent_contact_store_query_fields (fixture->store,
+                                     sexp,
+                                     fields,
+                                     NULL,
+                                     (GAsyncReadyCallback)query_contact_cb,
+                                     fixture);
+  g_clear_pointer (&query, e_book_query_unref);
+  g_clear_pointer (&sexp, g_free);
+  g_main_loop_run (fixture->loop);
+
+  contacts = g_steal_pointer (&fixture->result);
+  g_assert_nonnull (contacts->data);
+  contact = g_object_ref (contacts->data);
+  g_assert_true (E_IS_CONTACT (contact));
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_UID), ==, "test-contact");
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_FULL_NAME), ==, "Test Contact");
+  g_assert_null (e_vcard_get_attribute (E_VCARD (contact), EVC_TEL));
+  g_slist_free_full (contacts, g_object_unref);
+  contacts = NULL;
+  g_clear_object (&contact);
+
+  /* Base64 padding does not continue the property (e.g. a PHOTO) */
+  photo_contact = e_contact_new_from_vcard_with_uid (vcard_photo, "test-photo");
+  valent_contact_store_add_contact (fixture->store,
+                                    photo_contact,
+                                    NULL,
+                                    (GAsyncReadyCallback)add_contact_cb,
+                                    fixture);
+  g_main_loop_run (fixture->loop);
+  fixture->emitter = NULL;
+  fixture->emitted = NULL;
+
+  query = e_book_query_field_test (E_CONTACT_UID,
+                                   E_BOOK_QUERY_IS,
+                                   "test-photo");
+  sexp = e_book_query_to_string (query);
+
+  valent_contact_store_query_fields (fixture->store,
+                                     sexp,
+                                     photo_fields,
+                                     NULL,
+                                     (GAsyncReadyCallback)query_contact_cb,
+                                     fixture);
+  g_clear_pointer (&query, e_book_query_unref);
+  g_clear_pointer (&sexp, g_free);
+  g_main_loop_run (fixture->loop);
+
+  contacts = g_steal_pointer (&fixture->result);
+  g_assert_nonnull (contacts->data);
+  contact = g_object_ref (contacts->data);
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_UID), ==, "test-photo");
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_PHONE_MOBILE), ==, "555-0100");
+  g_slist_free_full (contacts, g_object_unref);
+  contacts = NULL;
+  g_clear_object (&contact);
+
+  valent_contact_store_remove_contact (fixture->store,
+                                       "test-photo",
+                                       NULL,
+                                       (GAsyncReadyCallback)remove_contact_cb,
+                                       fixture);
+  g_main_loop_run (fixture->loop);
+  fixture->emitter = NULL;
+  g_clear_pointer (&fixture->emitted, g_free);
+
   /* ::contact-removed is emitted when contacts are removed */
   valent_contact_store_remove_contact (fixture->store,
                                        "test-contact",
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <glib/gstdio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
+# include <sysprof-capture.h>
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
+
+#define N_THREADS (4)
+#define N_MARKS   (1000)
+
+
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
+static gpointer
+trace_thread_func (gpointer data)
+{
+  for (unsigned int i = 0; i < N_MARKS; i++)
+    {
+      int64_t begin_time = g_get_monotonic_time ();
+
+      valent_trace_mark (G_STRFUNC, begin_time, g_get_monotonic_time ());
+    }
+
+  return NULL;
+}
+
+typedef struct
+{
+  GMutex   mutex;
+  GCond    cond;
+  gboolean marked;
+  gboolean cleared;
+} IdleThread;
+
+static gpointer
+idle_thread_func (gpointer data)
+{
+  IdleThread *idle = data;
+
+  trace_thread_func (NULL);
+
+  /* Stay alive without tracing, until the buffers have been cleared */
+  g_mutex_lock (&idle->mutex);
+  idle->marked = TRUE;
+  g_cond_broadcast (&idle->cond);
+
+  while (!idle->cleared)
+    g_cond_wait (&idle->cond, &idle->mutex);
+  g_mutex_unlock (&idle->mutex);
+
+  return NULL;
+}
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
+
+static void
+test_debug_trace_marks (void)
+{
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
+  GThread *threads[N_THREADS];
+  GThread *idle_thread;
+  IdleThread idle = { 0, };
+  SysprofCaptureReader *reader = NULL;
+  SysprofCaptureFrameType type;
+  g_autofree char *path = NULL;
+  g_autofree char *fd_str = NULL;
+  unsigned int n_marks = 0;
+  int fd;
+  GError *error = NULL;
+
+  /* The capture writer takes ownership of the file descriptor */
+  fd = g_file_open_tmp ("valent-trace-XXXXXX.syscap", &path, &error);
+  g_assert_no_error (error);
+
+  fd_str = g_strdup_printf ("%d", fd);
+  g_setenv ("SYSPROF_TRACE_FD", fd_str, TRUE);
+  valent_debug_init ();
+  g_unsetenv ("SYSPROF_TRACE_FD");
+
+  VALENT_TEST_CHECK ("Marks are recorded from multiple threads");
+  for (unsigned int i = 0; i < N_THREADS; i++)
+    threads[i] = g_thread_new ("valent-trace", trace_thread_func, NULL);
+
+  /* Each thread flushes its remaining marks when it exits */
+  for (unsigned int i = 0; i < N_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  VALENT_TEST_CHECK ("Marks are flushed from every thread when cleared");
+  g_mutex_init (&idle.mutex);
+  g_cond_init (&idle.cond);
+  idle_thread = g_thread_new ("valent-trace-idle", idle_thread_func, &idle);
+
+  g_mutex_lock (&idle.mutex);
+  while (!idle.marked)
+    g_cond_wait (&idle.cond, &idle.mutex);
+  g_mutex_unlock (&idle.mutex);
+
+  trace_thread_func (NULL);
+  valent_debug_clear ();
+
+  g_mutex_lock (&idle.mutex);
+  idle.cleared = TRUE;
+  g_cond_broadcast (&idle.cond);
+  g_mutex_unlock (&idle.mutex);
+
+  g_thread_join (idle_thread);
+  g_mutex_clear (&idle.mutex);
+  g_cond_clear (&idle.cond);
+
+  reader = sysprof_capture_reader_new (path);
+  g_assert_nonnull (reader);
+
+  while (sysprof_capture_reader_peek_type (reader, &type))
+    {
+      if (type == SYSPROF_CAPTURE_FRAME_MARK)
+        {
+          const SysprofCaptureMark *mark;
+
+          mark = sysprof_capture_reader_read_mark (reader);
+          g_assert_nonnull (mark);
+
+          if (g_str_equal (mark->message, "trace_thread_func"))
+            n_marks++;
+        }
+      else if (!sysprof_capture_reader_skip (reader))
+        {
+          break;
+        }
+    }
+
+  g_assert_cmpuint (n_marks, ==, (N_THREADS + 2) * N_MARKS);
+
+  sysprof_capture_reader_unref (reader);
+  g_unlink (path);
+#else
+  g_test_skip ("Tracing with sysprof is not enabled");
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/libvalent/core/debug/trace-marks",
+                   test_debug_trace_marks);
+
+  return g_test_run ();
+}
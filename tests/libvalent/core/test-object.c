@@ -221,6 +221,72 @@ test_object_notify_thread (void)
   g_assert_null (g_thread_join (thread));
 }
 
+#define NOTIFY_COALESCE_COUNT (100000)
+
+static void
+on_notify_count (ValentObject *object,
+                 GParamSpec   *pspec,
+                 unsigned int *n_notified)
+{
+  g_assert_true (VALENT_IS_MAIN_THREAD());
+
+  *n_notified += 1;
+}
+
+static gpointer
+notify_coalesce_thread_func (ValentObject *object)
+{
+  GParamSpec *pspec;
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                        "cancellable");
+
+  for (unsigned int i = 0; i < NOTIFY_COALESCE_COUNT; i++)
+    {
+      if (i % 2 == 0)
+        valent_object_notify (object, "cancellable");
+      else
+        valent_object_notify_by_pspec (object, pspec);
+    }
+
+  return NULL;
+}
+
+static void
+test_object_notify_coalesce (void)
+{
+  g_autoptr (ValentObject) object = NULL;
+  g_autoptr (GThread) thread = NULL;
+  unsigned int n_notified = 0;
+  double elapsed;
+
+  object = g_object_new (VALENT_TYPE_OBJECT, NULL);
+  g_signal_connect (object,
+                    "notify::cancellable",
+                    G_CALLBACK (on_notify_count),
+                    &n_notified);
+
+  /* The main loop does not run until the thread is joined, so every
+   * notification should collapse into a single emission */
+  g_test_timer_start ();
+  thread = g_thread_new ("valent-object-notify",
+                         (GThreadFunc)notify_coalesce_thread_func,
+                         object);
+  g_assert_null (g_thread_join (g_steal_pointer (&thread)));
+  elapsed = g_test_timer_elapsed ();
+
+  while (g_main_context_iteration (NULL, FALSE))
+    continue;
+
+  g_assert_cmpuint (n_notified, ==, 1);
+
+  if (g_test_perf ())
+    {
+      g_test_maximized_result (NOTIFY_COALESCE_COUNT / elapsed,
+                               "%u notifications from a thread in %.3fs",
+                               NOTIFY_COALESCE_COUNT, elapsed);
+    }
+}
 
 int
 main (int   argc,
@@ -243,5 +309,8 @@ main (int   argc,
   g_test_add_func ("/libvalent/core/object/notify-thread",
                    test_object_notify_thread);
 
+  g_test_add_func ("/libvalent/core/object/notify-coalesce",
+                   test_object_notify_coalesce);
+
   g_test_run ();
 }
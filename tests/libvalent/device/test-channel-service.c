@@ -107,6 +107,38 @@ read_packet_cb (ValentChannel         *channel,
   g_main_loop_quit (fixture->loop);
 }
 
+static void
+read_packets_cb (ValentChannel         *channel,
+                 GAsyncResult          *result,
+                 ChannelServiceFixture *fixture)
+{
+  g_autoptr (GPtrArray) packets = NULL;
+  unsigned int remaining = GPOINTER_TO_UINT (fixture->data);
+  GError *error = NULL;
+
+  packets = valent_channel_read_packets_finish (channel, result, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (packets->len, >, 0);
+  g_assert_cmpuint (packets->len, <=, remaining);
+
+  for (unsigned int i = 0; i < packets->len; i++)
+    v_assert_packet_type (g_ptr_array_index (packets, i), "kdeconnect.mock.echo");
+
+  remaining -= packets->len;
+  fixture->data = GUINT_TO_POINTER (remaining);
+
+  if (remaining > 0)
+    {
+      valent_channel_read_packets (channel,
+                                   NULL,
+                                   (GAsyncReadyCallback)read_packets_cb,
+                                   fixture);
+      return;
+    }
+
+  g_main_loop_quit (fixture->loop);
+}
+
 static void
 write_packet_cb (ValentChannel         *channel,
                  GAsyncResult          *result,
@@ -367,6 +399,17 @@ test_channel_service_channel (ChannelServiceFixture *fixture,
                               fixture);
   g_main_loop_run (fixture->loop);
 
+  VALENT_TEST_CHECK ("Channel reads queued packets in batches");
+  for (unsigned int i = 0; i < 3; i++)
+    valent_channel_write_packet (fixture->channel, packet, NULL, NULL, NULL);
+
+  fixture->data = GUINT_TO_POINTER (3);
+  valent_channel_read_packets (fixture->endpoint,
+                               NULL,
+                               (GAsyncReadyCallback)read_packets_cb,
+                               fixture);
+  g_main_loop_run (fixture->loop);
+
   /* Download */
   valent_channel_read_packet (fixture->endpoint,
                               NULL,
@@ -16,6 +16,7 @@ test_device_transfer (ValentTestFixture *fixture,
   g_autoptr (GFileInfo) src_info = NULL;
   g_autoptr (GFile) dest = NULL;
   g_autoptr (GFileInfo) dest_info = NULL;
+  g_autoptr (GFile) partial = NULL;
   const char *dest_dir = NULL;
   JsonNode *packet = NULL;
   uint64_t src_btime_s, src_mtime_s, dest_mtime_s;
@@ -71,6 +72,10 @@ test_device_transfer (ValentTestFixture *fixture,
                                  &error);
   g_assert_no_error (error);
 
+  /* The partial download should have been moved into place */
+  partial = valent_get_user_file (dest_dir, "image.png.part", FALSE);
+  g_assert_false (g_file_query_exists (partial, NULL));
+
   /* FIXME: Setting mtime doesn't work in flatpak or CI */
   if (FALSE)
     {
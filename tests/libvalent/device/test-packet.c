@@ -187,6 +187,66 @@ test_packet_serializing (PacketFixture *fixture,
     }
 }
 
+static void
+test_packet_serializing_values (void)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet_in = NULL;
+  g_autoptr (JsonNode) packet_out = NULL;
+  g_autoptr (GString) packet_str = NULL;
+  JsonObject *body_in, *body_out;
+  size_t len;
+  GError *error = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.mock");
+  json_builder_set_member_name (builder, "string");
+  json_builder_add_string_value (builder, "\"quoted\" \\ \b\f\n\r\t\x01 \xc3\xa9");
+  json_builder_set_member_name (builder, "int");
+  json_builder_add_int_value (builder, G_MININT64);
+  json_builder_set_member_name (builder, "double");
+  json_builder_add_double_value (builder, 1.0);
+  json_builder_set_member_name (builder, "boolean");
+  json_builder_add_boolean_value (builder, FALSE);
+  json_builder_set_member_name (builder, "null");
+  json_builder_add_null_value (builder);
+  json_builder_set_member_name (builder, "array");
+  json_builder_begin_array (builder);
+  json_builder_add_int_value (builder, 0);
+  json_builder_begin_object (builder);
+  json_builder_end_object (builder);
+  json_builder_end_array (builder);
+  packet_in = valent_packet_end (&builder);
+  valent_packet_set_payload_size (packet_in, 42);
+
+  packet_str = g_string_new ("prefix");
+  len = valent_packet_to_gstring (packet_in, packet_str);
+  g_assert_cmpuint (len, ==, packet_str->len - strlen ("prefix"));
+  g_assert_true (g_str_has_prefix (packet_str->str, "prefix{\"id\":"));
+  g_assert_true (g_str_has_suffix (packet_str->str, "}\n"));
+
+  packet_out = valent_packet_deserialize (packet_str->str + strlen ("prefix"),
+                                          &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (valent_packet_get_id (packet_in), ==, 0);
+  g_assert_cmpint (valent_packet_get_id (packet_out), >, 0);
+  g_assert_cmpint (valent_packet_get_payload_size (packet_out), ==, 42);
+
+  body_in = valent_packet_get_body (packet_in);
+  body_out = valent_packet_get_body (packet_out);
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "string"),
+                                  json_object_get_member (body_out, "string")));
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "int"),
+                                  json_object_get_member (body_out, "int")));
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "double"),
+                                  json_object_get_member (body_out, "double")));
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "boolean"),
+                                  json_object_get_member (body_out, "boolean")));
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "null"),
+                                  json_object_get_member (body_out, "null")));
+  g_assert_true (json_node_equal (json_object_get_member (body_in, "array"),
+                                  json_object_get_member (body_out, "array")));
+}
+
 static void
 test_packet_invalid (PacketFixture *fixture,
                      gconstpointer  user_data)
@@ -293,6 +353,327 @@ test_packet_streaming (PacketFixture *fixture,
   g_clear_error (&error);
 }
 
+static void
+test_packet_streaming_buffered (PacketFixture *fixture,
+                                gconstpointer  user_data)
+{
+  JsonObjectIter iter;
+  JsonNode *packet_in, *packet_out;
+  g_autoptr (GInputStream) base_stream = NULL;
+  GInputStream *in = NULL;
+  GOutputStream *out = NULL;
+  g_autofree char *packet_str = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  GError *error = NULL;
+
+  /* Write packets */
+  out = g_memory_output_stream_new_resizable ();
+  json_object_iter_init (&iter, fixture->packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      valent_packet_to_stream (out, packet_in, NULL, &error);
+      g_assert_no_error (error);
+    }
+
+  g_output_stream_close (out, NULL, &error);
+  g_assert_no_error (error);
+
+  /* Read packets, with a buffer small enough to force it to grow */
+  bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+  base_stream = g_memory_input_stream_new_from_bytes (bytes);
+  in = g_buffered_input_stream_new_sized (base_stream, 16);
+  json_object_iter_init (&iter, fixture->packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      packet_out = valent_packet_from_stream (in, -1, NULL, &error);
+      g_assert_no_error (error);
+
+      g_assert_true (json_node_equal (packet_in, packet_out));
+      g_clear_pointer (&packet_out, json_node_unref);
+    }
+
+  packet_out = valent_packet_from_stream (in, -1, NULL, &error);
+  g_assert_error (error, VALENT_PACKET_ERROR, VALENT_PACKET_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+
+  g_clear_object (&out);
+  g_clear_object (&in);
+  g_clear_object (&base_stream);
+
+  /* Large input */
+  packet_str = json_to_string (fixture->large_node, FALSE);
+  base_stream = g_memory_input_stream_new_from_data (packet_str, -1, NULL);
+  in = g_buffered_input_stream_new_sized (base_stream, 4096);
+  packet_out = valent_packet_from_stream (in, -1, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_buffered_input_stream_get_buffer_size (G_BUFFERED_INPUT_STREAM (in)),
+                    ==,
+                    4096);
+  g_clear_object (&in);
+  g_clear_object (&base_stream);
+  g_clear_pointer (&packet_out, json_node_unref);
+
+  /* Oversized input */
+  base_stream = g_memory_input_stream_new_from_data ("1234567890", 10, NULL);
+  in = g_buffered_input_stream_new_sized (base_stream, 4);
+  packet_out = valent_packet_from_stream (in, 5, NULL, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+  g_clear_object (&in);
+  g_clear_object (&base_stream);
+  g_clear_error (&error);
+
+  base_stream = g_memory_input_stream_new_from_data ("123456789\n", 10, NULL);
+  in = g_buffered_input_stream_new (base_stream);
+  packet_out = valent_packet_from_stream (in, 5, NULL, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+  g_clear_object (&in);
+  g_clear_object (&base_stream);
+  g_clear_error (&error);
+}
+
+static const char * const corpus_files[] = {
+  "core.json",
+  "plugin-battery.json",
+  "plugin-clipboard.json",
+  "plugin-mpris.json",
+  "plugin-notification.json",
+  "plugin-sms.json",
+};
+
+static GBytes *
+load_packet_corpus (unsigned int  n_repeats,
+                    unsigned int *n_packets)
+{
+  g_autoptr (GByteArray) corpus = NULL;
+  g_autoptr (GByteArray) chunk = NULL;
+
+  chunk = g_byte_array_new ();
+  *n_packets = 0;
+
+  for (size_t i = 0; i < G_N_ELEMENTS (corpus_files); i++)
+    {
+      g_autoptr (JsonNode) node = NULL;
+      JsonObjectIter iter;
+      JsonNode *packet;
+
+      node = valent_test_load_json (corpus_files[i]);
+      json_object_iter_init (&iter, json_node_get_object (node));
+
+      while (json_object_iter_next (&iter, NULL, &packet))
+        {
+          g_autofree char *packet_str = NULL;
+
+          if (!valent_packet_is_valid (packet))
+            continue;
+
+          packet_str = valent_packet_serialize (packet);
+          g_byte_array_append (chunk,
+                               (const uint8_t *)packet_str,
+                               strlen (packet_str));
+          *n_packets += 1;
+        }
+    }
+
+  corpus = g_byte_array_sized_new (chunk->len * n_repeats);
+
+  for (unsigned int i = 0; i < n_repeats; i++)
+    g_byte_array_append (corpus, chunk->data, chunk->len);
+
+  *n_packets *= n_repeats;
+
+  return g_byte_array_free_to_bytes (g_steal_pointer (&corpus));
+}
+
+static double
+read_packet_corpus (GInputStream *in,
+                    unsigned int  n_packets)
+{
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < n_packets; i++)
+    {
+      g_autoptr (JsonNode) packet = NULL;
+      GError *error = NULL;
+
+      packet = valent_packet_from_stream (in, -1, NULL, &error);
+      g_assert_no_error (error);
+    }
+
+  return g_test_timer_elapsed ();
+}
+
+static void
+test_packet_framing_perf (void)
+{
+  g_autoptr (GBytes) corpus = NULL;
+  g_autoptr (GInputStream) base_stream = NULL;
+  g_autoptr (GInputStream) in = NULL;
+  unsigned int n_packets = 0;
+  double elapsed;
+
+  corpus = load_packet_corpus (1000, &n_packets);
+
+  /* Unbuffered (byte-at-a-time) framing */
+  in = g_memory_input_stream_new_from_bytes (corpus);
+  elapsed = read_packet_corpus (in, n_packets);
+  g_test_maximized_result (n_packets / elapsed,
+                           "unbuffered: %u packets in %.3fs",
+                           n_packets, elapsed);
+  g_clear_object (&in);
+
+  /* Buffered (chunked) framing */
+  base_stream = g_memory_input_stream_new_from_bytes (corpus);
+  in = g_buffered_input_stream_new_sized (base_stream, 64 * 1024);
+  elapsed = read_packet_corpus (in, n_packets);
+  g_test_maximized_result (n_packets / elapsed,
+                           "buffered: %u packets in %.3fs",
+                           n_packets, elapsed);
+}
+
+static JsonNode *
+create_notification_packet (size_t text_len)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autofree char *text = NULL;
+
+  text = g_strnfill (text_len, 'x');
+  memcpy (text, "\"Quoted\"\n", MIN (text_len, 10));
+
+  valent_packet_init (&builder, "kdeconnect.notification");
+  json_builder_set_member_name (builder, "id");
+  json_builder_add_string_value (builder, "0|org.gnome.Valent|1234|null|10001");
+  json_builder_set_member_name (builder, "appName");
+  json_builder_add_string_value (builder, "Valent");
+  json_builder_set_member_name (builder, "title");
+  json_builder_add_string_value (builder, "Notification Title");
+  json_builder_set_member_name (builder, "text");
+  json_builder_add_string_value (builder, text);
+  json_builder_set_member_name (builder, "ticker");
+  json_builder_add_string_value (builder, text);
+  json_builder_set_member_name (builder, "isClearable");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "time");
+  json_builder_add_string_value (builder, "1690000000000");
+
+  return valent_packet_end (&builder);
+}
+
+static JsonNode *
+create_messages_packet (unsigned int n_messages)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.sms.messages");
+  json_builder_set_member_name (builder, "messages");
+  json_builder_begin_array (builder);
+
+  for (unsigned int i = 0; i < n_messages; i++)
+    {
+      g_autofree char *text = NULL;
+
+      text = g_strdup_printf ("Message %u, with \"quotes\" and a line\nbreak", i);
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "addresses");
+      json_builder_begin_array (builder);
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "address");
+      json_builder_add_string_value (builder, "+1-234-567-8912");
+      json_builder_end_object (builder);
+      json_builder_end_array (builder);
+      json_builder_set_member_name (builder, "body");
+      json_builder_add_string_value (builder, text);
+      json_builder_set_member_name (builder, "date");
+      json_builder_add_int_value (builder, 1690000000000 + i);
+      json_builder_set_member_name (builder, "type");
+      json_builder_add_int_value (builder, 2);
+      json_builder_set_member_name (builder, "read");
+      json_builder_add_int_value (builder, 1);
+      json_builder_set_member_name (builder, "thread_id");
+      json_builder_add_int_value (builder, i % 50);
+      json_builder_set_member_name (builder, "_id");
+      json_builder_add_int_value (builder, i);
+      json_builder_set_member_name (builder, "sub_id");
+      json_builder_add_int_value (builder, 1);
+      json_builder_set_member_name (builder, "event");
+      json_builder_add_int_value (builder, 1);
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "version");
+  json_builder_add_int_value (builder, 2);
+
+  return valent_packet_end (&builder);
+}
+
+static void
+test_packet_serializing_perf (void)
+{
+  g_autoptr (GPtrArray) packets = NULL;
+  g_autoptr (GString) buffer = NULL;
+  unsigned int n_iterations = 200;
+  size_t n_bytes = 0;
+  double elapsed;
+
+  packets = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
+  g_ptr_array_add (packets, create_notification_packet (64));
+  g_ptr_array_add (packets, create_notification_packet (64 * 1024));
+  g_ptr_array_add (packets, create_messages_packet (10));
+  g_ptr_array_add (packets, create_messages_packet (1000));
+
+  /* JsonGenerator, as previously used by valent_packet_serialize() */
+  g_test_timer_start ();
+
+  for (unsigned int n = 0; n < n_iterations; n++)
+    {
+      for (unsigned int i = 0; i < packets->len; i++)
+        {
+          g_autoptr (JsonGenerator) generator = NULL;
+          g_autofree char *data = NULL;
+          g_autofree char *packet_str = NULL;
+          JsonNode *packet = g_ptr_array_index (packets, i);
+
+          json_object_set_int_member (json_node_get_object (packet),
+                                      "id",
+                                      valent_timestamp_ms ());
+
+          generator = json_generator_new ();
+          json_generator_set_root (generator, packet);
+          data = json_generator_to_data (generator, NULL);
+          packet_str = g_strconcat (data, "\n", NULL);
+          n_bytes += strlen (packet_str);
+        }
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_maximized_result (n_bytes / elapsed / (1024 * 1024),
+                           "JsonGenerator: %.1f MiB/s",
+                           n_bytes / elapsed / (1024 * 1024));
+
+  /* Packet writer, into a reused buffer */
+  buffer = g_string_sized_new (4096);
+  n_bytes = 0;
+  g_test_timer_start ();
+
+  for (unsigned int n = 0; n < n_iterations; n++)
+    {
+      for (unsigned int i = 0; i < packets->len; i++)
+        {
+          g_string_truncate (buffer, 0);
+          n_bytes += valent_packet_to_gstring (g_ptr_array_index (packets, i),
+                                               buffer);
+        }
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_maximized_result (n_bytes / elapsed / (1024 * 1024),
+                           "valent_packet_to_gstring(): %.1f MiB/s",
+                           n_bytes / elapsed / (1024 * 1024));
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -308,6 +689,9 @@ main (int   argc,
   g_test_add_func ("/libvalent/device/packet/get",
                    test_packet_get);
 
+  g_test_add_func ("/libvalent/device/packet/serializing-values",
+                   test_packet_serializing_values);
+
   g_test_add ("/libvalent/device/packet/invalid",
               PacketFixture, NULL,
               packet_fixture_set_up,
@@ -326,5 +710,19 @@ main (int   argc,
               test_packet_streaming,
               packet_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/packet/streaming-buffered",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_streaming_buffered,
+              packet_fixture_tear_down);
+
+  if (g_test_perf ())
+    {
+      g_test_add_func ("/libvalent/device/packet/framing-perf",
+                       test_packet_framing_perf);
+      g_test_add_func ("/libvalent/device/packet/serializing-perf",
+                       test_packet_serializing_perf);
+    }
+
   return g_test_run ();
 }
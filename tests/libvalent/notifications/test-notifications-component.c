@@ -191,6 +191,37 @@ test_notifications_component_self (NotificationsComponentFixture *fixture,
   g_signal_handlers_disconnect_by_data (fixture->adapter, fixture->notifications);
 }
 
+static void
+test_notifications_component_applications (NotificationsComponentFixture *fixture,
+                                           gconstpointer                  user_data)
+{
+  g_autoptr (GIcon) icon = NULL;
+  g_autoptr (GVariant) application = NULL;
+  g_autoptr (GVariant) iconv = NULL;
+  GVariant *applications;
+  const char *name;
+
+  VALENT_TEST_CHECK ("Applications are registered from notifications");
+  icon = g_themed_icon_new ("dialog-information-symbolic");
+  valent_notification_set_application (fixture->notification, "Test Application");
+  valent_notification_set_icon (fixture->notification, icon);
+  valent_notifications_adapter_notification_added (fixture->adapter, fixture->notification);
+
+  applications = valent_notifications_get_applications (fixture->notifications);
+  application = g_variant_lookup_value (applications,
+                                        "Test Application",
+                                        G_VARIANT_TYPE_VARDICT);
+  g_assert_nonnull (application);
+  g_assert_true (g_variant_lookup (application, "name", "&s", &name));
+  g_assert_cmpstr (name, ==, "Test Application");
+  iconv = g_variant_lookup_value (application, "icon", NULL);
+  g_assert_nonnull (iconv);
+
+  VALENT_TEST_CHECK ("Applications are not re-serialized for known notifications");
+  valent_notifications_adapter_notification_added (fixture->adapter, fixture->notification);
+  g_assert_true (valent_notifications_get_applications (fixture->notifications) == applications);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -215,5 +246,11 @@ main (int   argc,
               test_notifications_component_self,
               notifications_component_fixture_tear_down);
 
+  g_test_add ("/libvalent/notifications/applications",
+              NotificationsComponentFixture, NULL,
+              notifications_component_fixture_set_up,
+              test_notifications_component_applications,
+              notifications_component_fixture_tear_down);
+
   return g_test_run ();
 }
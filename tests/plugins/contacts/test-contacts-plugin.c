@@ -23,6 +23,17 @@ on_contact_added (ValentContactStore *store,
     }
 }
 
+static void
+on_contact_removed (ValentContactStore *store,
+                    const char         *uid,
+                    gboolean           *done)
+{
+  g_assert_cmpstr (uid, ==, "test-contact2");
+
+  g_signal_handlers_disconnect_by_data (store, done);
+  *done = TRUE;
+}
+
 static void
 valent_contact_store_query_cb (ValentContactStore  *store,
                                GAsyncResult        *result,
@@ -54,7 +65,9 @@ test_contacts_plugin_request_contacts (ValentTestFixture *fixture,
   g_autoslist (GObject) contacts = NULL;
   EBookQuery *query;
   g_autofree char *sexp = NULL;
+  JsonObject *body;
   JsonNode *packet;
+  JsonArray *uids;
 
   device = valent_test_fixture_get_device (fixture);
   store = valent_contacts_ensure_store (valent_contacts_get_default (),
@@ -108,6 +121,35 @@ test_contacts_plugin_request_contacts (ValentTestFixture *fixture,
 
   g_assert_cmpuint (g_slist_length (contacts), ==, 2);
 
+  VALENT_TEST_CHECK ("Plugin only requests vCard data for changed contacts");
+  packet = valent_packet_new ("kdeconnect.contacts.response_uids_timestamps");
+  body = valent_packet_get_body (packet);
+  json_object_set_int_member (body, "test-contact1", 1608700784336);
+  json_object_set_int_member (body, "test-contact2", 1608700799999);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.contacts.request_vcards_by_uid");
+  uids = json_object_get_array_member (valent_packet_get_body (packet), "uids");
+  g_assert_cmpuint (json_array_get_length (uids), ==, 1);
+  g_assert_cmpstr (json_array_get_string_element (uids, 0), ==, "test-contact2");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin removes contacts missing from the device");
+  packet = valent_packet_new ("kdeconnect.contacts.response_uids_timestamps");
+  body = valent_packet_get_body (packet);
+  json_object_set_int_member (body, "test-contact1", 1608700784336);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  done = FALSE;
+  g_signal_connect (store,
+                    "contact-removed",
+                    G_CALLBACK (on_contact_removed),
+                    &done);
+  valent_test_await_boolean (&done);
+
   valent_test_await_pending ();
 }
 
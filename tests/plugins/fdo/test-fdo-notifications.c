@@ -98,7 +98,8 @@ send_notification_cb (GDBusConnection         *connection,
 
 static void
 send_notification (FdoNotificationsFixture *fixture,
-                   gboolean                 with_pixbuf)
+                   gboolean                 with_pixbuf,
+                   gboolean                 short_rowstride)
 {
   GVariant *notification = NULL;
   GVariantBuilder actions_builder;
@@ -132,6 +133,11 @@ send_notification (FdoNotificationsFixture *fixture,
                     "pixels",          &pixels,
                     "has-alpha",       &has_alpha,
                     NULL);
+
+      /* A row shorter than its pixels, with a consistent data length */
+      if (short_rowstride)
+        rowstride = width * n_channels - 1;
+
       pixels_len = (height - 1) * rowstride + width *
         ((n_channels * bits_per_sample + 7) / 8);
 
@@ -207,7 +213,7 @@ test_fdo_notifications_source (FdoNotificationsFixture *fixture,
                     &notification_id);
 
   VALENT_TEST_CHECK ("Adapter adds notifications");
-  send_notification (fixture, FALSE);
+  send_notification (fixture, FALSE, FALSE);
   valent_test_await_pointer (&notification);
   g_assert_true (VALENT_IS_NOTIFICATION (notification));
 
@@ -236,8 +242,27 @@ test_fdo_notifications_source (FdoNotificationsFixture *fixture,
   g_clear_pointer (&notification_id, g_free);
 
   VALENT_TEST_CHECK ("Adapter adds notifications with pixbuf icons");
-  send_notification (fixture, TRUE);
+  send_notification (fixture, TRUE, FALSE);
+  valent_test_await_pointer (&notification);
+  g_clear_object (&icon);
+  g_object_get (notification, "icon", &icon, NULL);
+  g_assert_true (GDK_IS_PIXBUF (icon));
+  g_clear_object (&notification);
+
+  VALENT_TEST_CHECK ("Adapter deduplicates identical pixbuf icons");
+  send_notification (fixture, TRUE, FALSE);
+  valent_test_await_pointer (&notification);
+  g_assert_true (valent_notification_get_icon (notification) == icon);
+  g_clear_object (&notification);
+
+  VALENT_TEST_CHECK ("Adapter rejects pixbuf icons with a short rowstride");
+  g_test_expect_message ("valent-fdo-notifications",
+                         G_LOG_LEVEL_WARNING,
+                         "Unsupported image data*");
+  send_notification (fixture, TRUE, TRUE);
   valent_test_await_pointer (&notification);
+  g_test_assert_expected_messages ();
+  g_assert_null (valent_notification_get_icon (notification));
   g_clear_object (&notification);
 
   g_signal_handlers_disconnect_by_data (fixture->notifications, notification);
@@ -232,7 +232,7 @@ on_incoming_broadcast (GDataInputStream  *stream,
 static void
 on_incoming_transfer (ValentChannel *endpoint,
                       GAsyncResult  *result,
-                      gpointer       user_data)
+                      int64_t       *port)
 {
   g_autoptr (JsonNode) packet = NULL;
   g_autoptr (GIOStream) stream = NULL;
@@ -249,6 +249,13 @@ on_incoming_transfer (ValentChannel *endpoint,
   payload_size = valent_packet_get_payload_size (packet);
   g_assert_cmpint (payload_size, >, 0);
 
+  if (port != NULL)
+    {
+      JsonObject *info = valent_packet_get_payload_full (packet, NULL, NULL);
+
+      *port = json_object_get_int_member (info, "port");
+    }
+
   /* We expect to be able to create a transfer stream from the packet */
   stream = valent_channel_download (endpoint, packet, NULL, &error);
   g_assert_no_error (error);
@@ -640,6 +647,8 @@ test_lan_service_channel (LanBackendFixture *fixture,
   g_autoptr (GTlsCertificate) certificate = NULL;
   g_autoptr (GTlsCertificate) peer_certificate = NULL;
   uint16_t port;
+  int64_t transfer_port = 0;
+  int64_t transfer_port_reused = 0;
   g_autoptr (GFile) file = NULL;
 
   g_async_initable_init_async (G_ASYNC_INITABLE (fixture->service),
@@ -721,14 +730,158 @@ test_lan_service_channel (LanBackendFixture *fixture,
   valent_channel_read_packet (fixture->endpoint,
                               NULL,
                               (GAsyncReadyCallback)on_incoming_transfer,
-                              NULL);
+                              &transfer_port);
+  valent_test_upload (fixture->channel, packet, file, &error);
+  g_assert_no_error (error);
+
+  VALENT_TEST_CHECK ("Channel reuses transfer ports");
+  valent_channel_read_packet (fixture->endpoint,
+                              NULL,
+                              (GAsyncReadyCallback)on_incoming_transfer,
+                              &transfer_port_reused);
   valent_test_upload (fixture->channel, packet, file, &error);
   g_assert_no_error (error);
+  g_assert_cmpint (transfer_port, ==, transfer_port_reused);
 
   g_signal_handlers_disconnect_by_data (fixture->service, fixture);
   valent_object_destroy (VALENT_OBJECT (fixture->service));
 }
 
+typedef struct
+{
+  GSocketListener *listener;
+  GTlsCertificate *certificate;
+  GTlsCertificate *peer_certificate;
+  unsigned int     n_connections;
+} TransferServer;
+
+static gpointer
+transfer_server_thread (gpointer data)
+{
+  TransferServer *server = data;
+
+  for (unsigned int i = 0; i < server->n_connections; i++)
+    {
+      g_autoptr (GSocketConnection) connection = NULL;
+      g_autoptr (GIOStream) tls_stream = NULL;
+      GError *error = NULL;
+
+      connection = g_socket_listener_accept (server->listener, NULL, NULL, &error);
+      g_assert_no_error (error);
+
+      tls_stream = valent_lan_encrypt_server (connection,
+                                              server->certificate,
+                                              server->peer_certificate,
+                                              NULL,
+                                              &error);
+      g_assert_no_error (error);
+
+      /* Write a byte, so the client receives any post-handshake session ticket
+       * as it would when reading a payload */
+      g_output_stream_write_all (g_io_stream_get_output_stream (tls_stream),
+                                 "\0", 1, NULL, NULL, &error);
+      g_assert_no_error (error);
+      g_io_stream_close (tls_stream, NULL, NULL);
+    }
+
+  return NULL;
+}
+
+static double
+transfer_client_run (TransferServer *server,
+                     unsigned int    n_connections,
+                     gboolean        resume)
+{
+  g_autoptr (GSocketClient) client = NULL;
+  g_autoptr (GIOStream) session = NULL;
+  double elapsed = 0.0;
+
+  client = g_object_new (G_TYPE_SOCKET_CLIENT,
+                         "enable-proxy", FALSE,
+                         NULL);
+
+  for (unsigned int i = 0; i < n_connections; i++)
+    {
+      g_autoptr (GSocketConnection) connection = NULL;
+      g_autoptr (GIOStream) tls_stream = NULL;
+      uint8_t byte;
+      GError *error = NULL;
+
+      g_test_timer_start ();
+      connection = g_socket_client_connect_to_host (client,
+                                                    "127.0.0.1",
+                                                    VALENT_LAN_TRANSFER_PORT_MIN,
+                                                    NULL,
+                                                    &error);
+      g_assert_no_error (error);
+
+      tls_stream = valent_lan_encrypt_client (connection,
+                                              server->peer_certificate,
+                                              server->certificate,
+                                              resume ? session : NULL,
+                                              NULL,
+                                              &error);
+      g_assert_no_error (error);
+      elapsed += g_test_timer_elapsed ();
+
+      g_input_stream_read_all (g_io_stream_get_input_stream (tls_stream),
+                               &byte, 1, NULL, NULL, &error);
+      g_assert_no_error (error);
+      g_io_stream_close (tls_stream, NULL, NULL);
+
+      g_set_object (&session, tls_stream);
+    }
+
+  return elapsed;
+}
+
+static void
+test_lan_transfer_resumption_perf (void)
+{
+  TransferServer server = { NULL, };
+  g_autofree char *path = NULL;
+  g_autofree char *peer_path = NULL;
+  g_autoptr (GThread) thread = NULL;
+  unsigned int n_connections = 200;
+  double full, resumed;
+  GError *error = NULL;
+
+  path = g_dir_make_tmp ("XXXXXX.valent", NULL);
+  server.certificate = valent_certificate_new_sync (path, &error);
+  g_assert_no_error (error);
+
+  peer_path = g_dir_make_tmp ("XXXXXX.valent", NULL);
+  server.peer_certificate = valent_certificate_new_sync (peer_path, &error);
+  g_assert_no_error (error);
+
+  server.listener = g_socket_listener_new ();
+  g_socket_listener_add_inet_port (server.listener,
+                                   VALENT_LAN_TRANSFER_PORT_MIN,
+                                   NULL,
+                                   &error);
+  g_assert_no_error (error);
+
+  server.n_connections = n_connections * 2;
+  thread = g_thread_new ("transfer-server", transfer_server_thread, &server);
+
+  full = transfer_client_run (&server, n_connections, FALSE);
+  g_test_message ("full handshake: %u connections in %.3fs (%.3fms each)",
+                  n_connections, full, (full / n_connections) * 1000);
+
+  resumed = transfer_client_run (&server, n_connections, TRUE);
+  g_test_minimized_result (resumed / n_connections,
+                           "resumed handshake: %u connections in %.3fs (%.3fms each)",
+                           n_connections, resumed,
+                           (resumed / n_connections) * 1000);
+
+  g_thread_join (g_steal_pointer (&thread));
+  g_socket_listener_close (server.listener);
+
+  g_clear_object (&server.listener);
+  g_clear_object (&server.certificate);
+  g_clear_object (&server.peer_certificate);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -771,5 +924,9 @@ main (int   argc,
               test_lan_service_channel,
               lan_service_fixture_tear_down);
 
+  if (g_test_perf ())
+    g_test_add_func ("/plugins/lan/transfer-resumption-perf",
+                     test_lan_transfer_resumption_perf);
+
   return g_test_run ();
 }
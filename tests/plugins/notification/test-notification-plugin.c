@@ -199,6 +199,18 @@ test_notification_plugin_send_notification (ValentTestFixture *fixture,
   valent_test_fixture_download (fixture, packet, NULL);
   json_node_unref (packet);
 
+  VALENT_TEST_CHECK ("Plugin uploads repeated icons with the payload");
+  valent_notifications_adapter_notification_added (adapter, notification);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.notification");
+  v_assert_packet_cmpstr (packet, "id", ==, "test-id");
+  v_assert_packet_field (packet, "payloadHash");
+  g_assert_true (valent_packet_has_payload (packet));
+
+  valent_test_fixture_download (fixture, packet, NULL);
+  json_node_unref (packet);
+
   VALENT_TEST_CHECK ("Plugin forwards notification removals");
   valent_notifications_adapter_notification_removed (adapter, "test-id");
 
@@ -3,6 +3,8 @@
 
 #include <math.h>
 
+#include <glib/gstdio.h>
+
 #include <valent.h>
 #include <libvalent-test.h>
 
@@ -180,17 +182,26 @@ test_share_upload_multiple (ValentTestFixture *fixture,
   v_assert_packet_cmpint (packet, "totalPayloadSize", ==, total_size);
   json_node_unref (packet);
 
+  /* Files are uploaded concurrently, so the requests may arrive in any order */
   for (unsigned int i = 0; i < n_test_files; i++)
     {
+      const char *filename = NULL;
+      unsigned int index = 0;
+
       packet = valent_test_fixture_expect_packet (fixture);
       v_assert_packet_type (packet, "kdeconnect.share.request");
-      v_assert_packet_cmpstr (packet, "filename", ==, file_name[i]);
+      v_assert_packet_field (packet, "filename");
       v_assert_packet_field (packet, "creationTime");
       v_assert_packet_field (packet, "lastModified");
       v_assert_packet_cmpint (packet, "numberOfFiles", ==, n_test_files);
       v_assert_packet_cmpint (packet, "totalPayloadSize", ==, total_size);
 
-      g_assert_cmpint (valent_packet_get_payload_size (packet), ==, file_size[i]);
+      valent_packet_get_string (packet, "filename", &filename);
+      while (index < n_test_files && !g_str_equal (file_name[index], filename))
+        index++;
+
+      g_assert_cmpuint (index, <, n_test_files);
+      g_assert_cmpint (valent_packet_get_payload_size (packet), ==, file_size[index]);
 
       valent_test_fixture_download (fixture, packet, &error);
       g_assert_no_error (error);
@@ -201,6 +212,119 @@ test_share_upload_multiple (ValentTestFixture *fixture,
   g_clear_pointer (&file_name, g_strfreev);
 }
 
+static void
+upload_perf_cb (ValentTransfer *transfer,
+                GAsyncResult   *result,
+                gboolean       *done)
+{
+  GError *error = NULL;
+
+  g_assert_true (valent_transfer_execute_finish (transfer, result, &error));
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static double
+share_upload_files (ValentTestFixture *fixture,
+                    GListModel        *files,
+                    unsigned int       max_active)
+{
+  g_autoptr (ValentTransfer) transfer = NULL;
+  unsigned int n_files = g_list_model_get_n_items (files);
+  gboolean done = FALSE;
+  JsonNode *packet = NULL;
+  GError *error = NULL;
+
+  transfer = g_object_new (VALENT_TYPE_SHARE_UPLOAD,
+                           "device",     fixture->device,
+                           "max-active", max_active,
+                           NULL);
+  valent_share_upload_add_files (VALENT_SHARE_UPLOAD (transfer), files);
+
+  g_test_timer_start ();
+  valent_transfer_execute (transfer,
+                           NULL,
+                           (GAsyncReadyCallback)upload_perf_cb,
+                           &done);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.share.request.update");
+  json_node_unref (packet);
+
+  for (unsigned int i = 0; i < n_files; i++)
+    {
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.share.request");
+
+      valent_test_fixture_download (fixture, packet, &error);
+      g_assert_no_error (error);
+      json_node_unref (packet);
+    }
+
+  while (!done)
+    g_main_context_iteration (NULL, FALSE);
+
+  g_assert_cmpfloat (valent_transfer_get_progress (transfer), ==, 1.0);
+
+  return g_test_timer_elapsed ();
+}
+
+static void
+test_share_upload_perf (ValentTestFixture *fixture,
+                        gconstpointer      user_data)
+{
+  g_autoptr (GListStore) files = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *contents = NULL;
+  unsigned int n_files = 128;
+  size_t file_size = 4096;
+  double elapsed;
+  GError *error = NULL;
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  /* Prepare a directory of small files */
+  tmpdir = g_dir_make_tmp ("valent-share-upload-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  contents = g_strnfill (file_size, 'x');
+  files = g_list_store_new (G_TYPE_FILE);
+
+  for (unsigned int i = 0; i < n_files; i++)
+    {
+      g_autofree char *basename = g_strdup_printf ("file-%03u.txt", i);
+      g_autofree char *path = g_build_filename (tmpdir, basename, NULL);
+      g_autoptr (GFile) file = NULL;
+
+      g_file_set_contents (path, contents, file_size, &error);
+      g_assert_no_error (error);
+
+      file = g_file_new_for_path (path);
+      g_list_store_append (files, file);
+    }
+
+  elapsed = share_upload_files (fixture, G_LIST_MODEL (files), 1);
+  g_test_minimized_result (elapsed,
+                           "sequential: %u files in %.3fs",
+                           n_files, elapsed);
+
+  elapsed = share_upload_files (fixture, G_LIST_MODEL (files), 4);
+  g_test_minimized_result (elapsed,
+                           "concurrent (4): %u files in %.3fs",
+                           n_files, elapsed);
+
+  /* Cleanup */
+  for (unsigned int i = 0; i < n_files; i++)
+    {
+      g_autoptr (GFile) file = g_list_model_get_item (G_LIST_MODEL (files), i);
+
+      g_file_delete (file, NULL, NULL);
+    }
+
+  g_rmdir (tmpdir);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -221,5 +345,14 @@ main (int   argc,
               test_share_upload_multiple,
               valent_test_fixture_clear);
 
+  if (g_test_perf ())
+    {
+      g_test_add ("/plugins/share/upload-perf",
+                  ValentTestFixture, path,
+                  valent_test_fixture_init,
+                  test_share_upload_perf,
+                  valent_test_fixture_clear);
+    }
+
   return g_test_run ();
 }
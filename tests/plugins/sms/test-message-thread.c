@@ -57,6 +57,117 @@ test_sms_message_thread (void)
   /* valent_test_await_signal (thread, "items-changed"); */
 }
 
+static void
+add_messages_cb (ValentSmsStore *store,
+                 GAsyncResult   *result,
+                 GMainLoop      *loop)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_sms_store_add_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (loop);
+}
+
+static gboolean
+thread_is_hydrated (GListModel   *thread,
+                    unsigned int  start,
+                    unsigned int  end)
+{
+  for (unsigned int i = start; i < end; i++)
+    {
+      g_autoptr (ValentMessage) message = g_list_model_get_item (thread, i);
+
+      if (valent_message_get_box (message) == 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+test_sms_message_thread_perf (void)
+{
+  g_autoptr (GMainLoop) loop = NULL;
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (ValentSmsStore) store = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GVariant) metadata = NULL;
+  g_autoptr (GListModel) thread = NULL;
+  g_autoptr (GFile) file = NULL;
+  unsigned int n_messages = 5000;
+  unsigned int n_visible = 50;
+  double elapsed;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  context = g_object_new (VALENT_TYPE_CONTEXT,
+                          "domain", "device",
+                          "id",     "test-perf-thread",
+                          NULL);
+  file = valent_context_get_cache_file (context, "sms.db");
+  g_file_delete (file, NULL, NULL);
+  store = valent_sms_store_new (context);
+
+  messages = g_ptr_array_new_full (n_messages, g_object_unref);
+  metadata = g_variant_ref_sink (g_variant_new ("a{sv}", NULL));
+
+  for (unsigned int i = 0; i < n_messages; i++)
+    {
+      g_autofree char *text = g_strdup_printf ("Message %u", i);
+
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      (int64_t)i,
+                                     "id",        (int64_t)i,
+                                     "metadata",  metadata,
+                                     "read",      TRUE,
+                                     "sender",    "+1-234-567-8910",
+                                     "text",      text,
+                                     "thread-id", (int64_t)1,
+                                     NULL));
+    }
+
+  valent_sms_store_add_messages (store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 loop);
+  g_main_loop_run (loop);
+
+  /* Time from opening the thread until the first screen is hydrated */
+  g_test_timer_start ();
+  thread = valent_sms_store_get_thread (store, 1);
+  valent_test_await_signal (thread, "items-changed");
+  g_assert_cmpuint (g_list_model_get_n_items (thread), ==, n_messages);
+
+  for (unsigned int i = 0; i < n_visible; i++)
+    g_object_unref (g_list_model_get_item (thread, i));
+
+  while (!thread_is_hydrated (thread, 0, n_visible))
+    g_main_context_iteration (NULL, TRUE);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+                           "first %u of %u messages in %.3fms",
+                           n_visible, n_messages, elapsed * 1000);
+
+  /* Time to scroll through the whole thread, one item at a time */
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < n_messages; i++)
+    g_object_unref (g_list_model_get_item (thread, i));
+
+  while (!thread_is_hydrated (thread, 0, n_messages))
+    g_main_context_iteration (NULL, TRUE);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+                           "%u messages in %.3fs",
+                           n_messages, elapsed);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -66,6 +177,10 @@ main (int   argc,
   g_test_add_func ("/plugins/sms/message-thread",
                    test_sms_message_thread);
 
+  if (g_test_perf ())
+    g_test_add_func ("/plugins/sms/message-thread-perf",
+                     test_sms_message_thread_perf);
+
   return g_test_run ();
 }
 
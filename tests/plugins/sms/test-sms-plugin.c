@@ -56,25 +56,154 @@ test_sms_plugin_handle_request (ValentTestFixture *fixture,
   packet = valent_test_fixture_lookup_packet (fixture, "thread-digest");
   valent_test_fixture_handle_packet (fixture, packet);
 
-  VALENT_TEST_CHECK ("Plugin responds the thread list, requesting a thread (1)");
+  VALENT_TEST_CHECK ("Plugin requests a page of the most recent thread first (2)");
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.sms.request_conversation");
+  v_assert_packet_cmpint (packet, "threadID", ==, 2);
+  v_assert_packet_cmpint (packet, "numberToRequest", >, 0);
+  v_assert_packet_no_field (packet, "rangeStartTimestamp");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin requests a page of the next thread (1)");
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.sms.request_conversation");
   v_assert_packet_cmpint (packet, "threadID", ==, 1);
+  v_assert_packet_cmpint (packet, "numberToRequest", >, 0);
   json_node_unref (packet);
 
+  VALENT_TEST_CHECK ("Plugin handles the requested thread (2)");
+  packet = valent_test_fixture_lookup_packet (fixture, "thread-2");
+  valent_test_fixture_handle_packet (fixture, packet);
+
   VALENT_TEST_CHECK ("Plugin handles the requested thread (1)");
   packet = valent_test_fixture_lookup_packet (fixture, "thread-1");
   valent_test_fixture_handle_packet (fixture, packet);
+}
+
+/*
+ * Build a `kdeconnect.sms.messages` packet with @n_messages for each thread in
+ * @thread_ids, dated backwards from @date.
+ */
+static JsonNode *
+create_messages_packet (const int64_t *thread_ids,
+                        unsigned int   n_threads,
+                        unsigned int   n_messages,
+                        int64_t        date)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.sms.messages");
+  json_builder_set_member_name (builder, "messages");
+  json_builder_begin_array (builder);
+
+  for (unsigned int t = 0; t < n_threads; t++)
+    {
+      for (unsigned int i = 0; i < n_messages; i++)
+        {
+          json_builder_begin_object (builder);
+          json_builder_set_member_name (builder, "addresses");
+          json_builder_begin_array (builder);
+          json_builder_begin_object (builder);
+          json_builder_set_member_name (builder, "address");
+          json_builder_add_string_value (builder, "+1-234-567-8912");
+          json_builder_end_object (builder);
+          json_builder_end_array (builder);
+          json_builder_set_member_name (builder, "body");
+          json_builder_add_string_value (builder, "Backfill");
+          json_builder_set_member_name (builder, "date");
+          json_builder_add_int_value (builder, date - (t * 1000) - i);
+          json_builder_set_member_name (builder, "type");
+          json_builder_add_int_value (builder, 1);
+          json_builder_set_member_name (builder, "read");
+          json_builder_add_int_value (builder, 1);
+          json_builder_set_member_name (builder, "thread_id");
+          json_builder_add_int_value (builder, thread_ids[t]);
+          json_builder_set_member_name (builder, "_id");
+          json_builder_add_int_value (builder, (thread_ids[t] * 1000) + i);
+          json_builder_set_member_name (builder, "sub_id");
+          json_builder_add_int_value (builder, 1);
+          json_builder_set_member_name (builder, "event");
+          json_builder_add_int_value (builder, 1);
+          json_builder_end_object (builder);
+        }
+    }
+
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "version");
+  json_builder_add_int_value (builder, 2);
+
+  return valent_packet_end (&builder);
+}
+
+static void
+test_sms_plugin_backfill (ValentTestFixture *fixture,
+                          gconstpointer      user_data)
+{
+  static const int64_t thread_ids[] = { 10, 11, 12, 13 };
+  JsonNode *packet;
+
+  valent_test_fixture_connect (fixture, TRUE);
 
-  VALENT_TEST_CHECK ("Plugin responds the thread list, requesting a thread (2)");
   packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.sms.request_conversation");
-  v_assert_packet_cmpint (packet, "threadID", ==, 2);
+  v_assert_packet_type (packet, "kdeconnect.sms.request_conversations");
   json_node_unref (packet);
 
-  VALENT_TEST_CHECK ("Plugin handles the requested thread (2)");
-  packet = valent_test_fixture_lookup_packet (fixture, "thread-2");
+  VALENT_TEST_CHECK ("Plugin handles the thread list");
+  packet = create_messages_packet (thread_ids, G_N_ELEMENTS (thread_ids), 1, 100000);
   valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin requests a page of the two most recent threads");
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 10);
+  v_assert_packet_no_field (packet, "rangeStartTimestamp");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 11);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin requests the next page of a thread after a full page");
+  packet = create_messages_packet (&thread_ids[0], 1, 100, 100000);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 10);
+  v_assert_packet_cmpint (packet, "rangeStartTimestamp", ==, 100000 - 99);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin requests the next thread after a short page");
+  packet = create_messages_packet (&thread_ids[1], 1, 1, 99000);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 12);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin requests the next thread after an empty final page");
+  packet = create_messages_packet (NULL, 0, 0, 0);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 13);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin does not take a new message as a page of a pending thread");
+  packet = create_messages_packet (&thread_ids[2], 1, 1, 200000);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = create_messages_packet (&thread_ids[2], 1, 100, 98000);
+  valent_test_fixture_handle_packet (fixture, packet);
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "threadID", ==, 12);
+  v_assert_packet_cmpint (packet, "rangeStartTimestamp", ==, 98000 - 99);
+  json_node_unref (packet);
 }
 
 static const char *schemas[] = {
@@ -118,6 +247,12 @@ main (int   argc,
               test_sms_plugin_handle_request,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/sms/backfill",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_sms_plugin_backfill,
+              valent_test_fixture_clear);
+
   g_test_add ("/plugins/sms/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -7,6 +7,7 @@
 
 #include "test-sms-common.h"
 #include "valent-sms-store.h"
+#include "valent-sms-store-private.h"
 
 
 static int n_messages = 0;
@@ -59,6 +60,25 @@ get_message_cb (ValentSmsStore *store,
   g_main_loop_quit (loop);
 }
 
+static void
+get_thread_dates_cb (ValentSmsStore *store,
+                     GAsyncResult   *result,
+                     GMainLoop      *loop)
+{
+  g_autoptr (GArray) dates = NULL;
+  g_autoptr (GError) error = NULL;
+
+  dates = valent_sms_store_get_thread_dates_finish (store, result, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (dates);
+  g_assert_cmpuint (dates->len, ==, 3);
+  g_assert_cmpint (g_array_index (dates, int64_t, 0), ==, 2);
+  g_assert_cmpint (g_array_index (dates, int64_t, 1), ==, 3);
+  g_assert_cmpint (g_array_index (dates, int64_t, 2), ==, 0);
+
+  g_main_loop_quit (loop);
+}
+
 static void
 remove_message_cb (ValentSmsStore *store,
                    GAsyncResult   *result,
@@ -129,6 +149,7 @@ test_sms_store (void)
   g_autoptr (ValentSmsStore) store = NULL;
   g_autoptr (GPtrArray) messages = NULL;
   g_autoptr (GListModel) summary = NULL;
+  g_autoptr (GArray) thread_ids = NULL;
   int64_t thread_date;
 
   loop = g_main_loop_new (NULL, FALSE);
@@ -181,6 +202,16 @@ test_sms_store (void)
   thread_date = valent_sms_store_get_thread_date (store, 2);
   g_assert_cmpint (thread_date, ==, 3);
 
+  VALENT_TEST_CHECK ("Store method `get_thread_dates()` works");
+  thread_ids = g_array_new (FALSE, FALSE, sizeof (int64_t));
+  g_array_append_vals (thread_ids, (int64_t[]){ 1, 2, 3 }, 3);
+  valent_sms_store_get_thread_dates (store,
+                                     thread_ids,
+                                     NULL,
+                                     (GAsyncReadyCallback)get_thread_dates_cb,
+                                     loop);
+  g_main_loop_run (loop);
+
   VALENT_TEST_CHECK ("Store can have messages searched");
   valent_sms_store_find_messages (store,
                                   "Message 1",
@@ -189,6 +220,14 @@ test_sms_store (void)
                                   loop);
   g_main_loop_run (loop);
 
+  VALENT_TEST_CHECK ("Store can have messages searched by prefix");
+  valent_sms_store_find_messages (store,
+                                  "Mess",
+                                  NULL,
+                                  (GAsyncReadyCallback)find_messages_cb,
+                                  loop);
+  g_main_loop_run (loop);
+
   VALENT_TEST_CHECK ("Store can retrieve messages by ID");
   valent_sms_store_get_message (store,
                                 1,
@@ -238,6 +277,240 @@ test_sms_store (void)
   g_assert_cmpint (n_messages, ==, 0);
 }
 
+static GPtrArray *
+create_message_history (unsigned int n_history,
+                        unsigned int n_threads)
+{
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GVariant) metadata = NULL;
+  static const char * const words[] = {
+    "lunch", "tomorrow", "meeting", "photo", "call", "weekend", "dinner",
+    "address", "running", "late", "thanks", "birthday",
+  };
+
+  messages = g_ptr_array_new_full (n_history, g_object_unref);
+  metadata = g_variant_ref_sink (g_variant_new ("a{sv}", NULL));
+
+  for (unsigned int i = 0; i < n_history; i++)
+    {
+      g_autofree char *text = NULL;
+
+      text = g_strdup_printf ("Synthetic message %u about %s and %s",
+                              i,
+                              words[i % G_N_ELEMENTS (words)],
+                              words[(i / 7) % G_N_ELEMENTS (words)]);
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      (int64_t)i,
+                                     "id",        (int64_t)i,
+                                     "metadata",  metadata,
+                                     "read",      TRUE,
+                                     "sender",    "+1-234-567-8910",
+                                     "text",      text,
+                                     "thread-id", (int64_t)(i % n_threads),
+                                     NULL));
+    }
+
+  return g_steal_pointer (&messages);
+}
+
+static ValentSmsStore *
+create_store (const char *id)
+{
+  g_autoptr (ValentContext) context = NULL;
+  static const char * const db_files[] = {
+    "sms.db", "sms.db-wal", "sms.db-shm",
+  };
+
+  context = g_object_new (VALENT_TYPE_CONTEXT,
+                          "domain", "device",
+                          "id",     id,
+                          NULL);
+
+  /* Start from an empty database */
+  for (unsigned int i = 0; i < G_N_ELEMENTS (db_files); i++)
+    {
+      g_autoptr (GFile) file = NULL;
+
+      file = valent_context_get_cache_file (context, db_files[i]);
+      g_file_delete (file, NULL, NULL);
+    }
+
+  return valent_sms_store_new (context);
+}
+
+static void
+test_sms_store_cache (void)
+{
+  g_autoptr (GMainLoop) loop = NULL;
+  g_autoptr (ValentSmsStore) store = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GVariant) metadata = NULL;
+  ValentMessage *message;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  store = create_store ("test-cache");
+
+  /* Two messages with the same ID, in different threads */
+  messages = g_ptr_array_new_with_free_func (g_object_unref);
+  metadata = g_variant_ref_sink (g_variant_new ("a{sv}", NULL));
+
+  for (int64_t thread_id = 1; thread_id <= 2; thread_id++)
+    {
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      thread_id,
+                                     "id",        (int64_t)1,
+                                     "metadata",  metadata,
+                                     "read",      TRUE,
+                                     "sender",    "+1-234-567-8910",
+                                     "text",      "Shared message ID",
+                                     "thread-id", thread_id,
+                                     NULL));
+    }
+
+  valent_sms_store_add_messages (store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 loop);
+  g_main_loop_run (loop);
+
+  valent_sms_store_cache_message (store, g_ptr_array_index (messages, 0));
+  valent_sms_store_cache_message (store, g_ptr_array_index (messages, 1));
+
+  VALENT_TEST_CHECK ("Cache distinguishes messages by thread");
+  message = valent_sms_store_lookup_message (store, 1, 1);
+  g_assert_true (message == g_ptr_array_index (messages, 0));
+  g_clear_object (&message);
+
+  message = valent_sms_store_lookup_message (store, 2, 1);
+  g_assert_true (message == g_ptr_array_index (messages, 1));
+  g_clear_object (&message);
+
+  message = valent_sms_store_lookup_message (store, 3, 1);
+  g_assert_null (message);
+
+  VALENT_TEST_CHECK ("Cache only evicts messages from the removed thread");
+  valent_sms_store_remove_thread (store,
+                                  1,
+                                  NULL,
+                                  (GAsyncReadyCallback)remove_thread_cb,
+                                  loop);
+  g_main_loop_run (loop);
+
+  message = valent_sms_store_lookup_message (store, 1, 1);
+  g_assert_null (message);
+
+  message = valent_sms_store_lookup_message (store, 2, 1);
+  g_assert_true (message == g_ptr_array_index (messages, 1));
+  g_clear_object (&message);
+}
+
+static void
+test_sms_store_add_perf (void)
+{
+  g_autoptr (GMainLoop) loop = NULL;
+  g_autoptr (ValentSmsStore) store = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  unsigned int n_history = 100000;
+  double elapsed;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  store = create_store ("test-perf-add");
+  messages = create_message_history (n_history, 100);
+
+  g_test_timer_start ();
+  valent_sms_store_add_messages (store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 loop);
+  g_main_loop_run (loop);
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_maximized_result (n_history / elapsed,
+                           "%u messages in %.3fs (%.0f messages/s)",
+                           n_history, elapsed, n_history / elapsed);
+}
+
+static void
+find_messages_perf_cb (ValentSmsStore *store,
+                       GAsyncResult   *result,
+                       GMainLoop      *loop)
+{
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GError) error = NULL;
+
+  messages = valent_sms_store_find_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (messages->len, >, 0);
+
+  g_main_loop_quit (loop);
+}
+
+static void
+test_sms_store_query_perf (void)
+{
+  static const unsigned int sizes[] = { 10000, 100000, 1000000 };
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      g_autoptr (GMainLoop) loop = NULL;
+      g_autoptr (ValentSmsStore) store = NULL;
+      g_autoptr (GPtrArray) messages = NULL;
+      g_autoptr (GListModel) summary = NULL;
+      g_autofree char *id = NULL;
+      unsigned int n_threads = sizes[i] / 100;
+      gulong signal_id;
+      double elapsed;
+
+      loop = g_main_loop_new (NULL, FALSE);
+      id = g_strdup_printf ("test-perf-query-%u", sizes[i]);
+      store = create_store (id);
+      messages = create_message_history (sizes[i], n_threads);
+
+      valent_sms_store_add_messages (store,
+                                     messages,
+                                     NULL,
+                                     (GAsyncReadyCallback)add_messages_cb,
+                                     loop);
+      g_main_loop_run (loop);
+
+      /* Thread summary */
+      g_test_timer_start ();
+      summary = valent_sms_store_get_summary (store);
+      signal_id = g_signal_connect (summary,
+                                    "items-changed",
+                                    G_CALLBACK (on_summary_items_changed),
+                                    loop);
+      g_main_loop_run (loop);
+      elapsed = g_test_timer_elapsed ();
+      g_clear_signal_handler (&signal_id, summary);
+
+      g_assert_cmpuint (g_list_model_get_n_items (summary), ==, n_threads);
+      g_test_minimized_result (elapsed,
+                               "summary (%u rows, %u threads): %.1fms",
+                               sizes[i], n_threads, elapsed * 1000);
+
+      /* Full-text search */
+      g_test_timer_start ();
+      valent_sms_store_find_messages (store,
+                                      "about din",
+                                      NULL,
+                                      (GAsyncReadyCallback)find_messages_perf_cb,
+                                      loop);
+      g_main_loop_run (loop);
+      elapsed = g_test_timer_elapsed ();
+
+      g_test_minimized_result (elapsed,
+                               "search (%u rows): %.1fms",
+                               sizes[i], elapsed * 1000);
+    }
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -247,6 +520,17 @@ main (int   argc,
   g_test_add_func ("/plugins/sms/store",
                    test_sms_store);
 
+  g_test_add_func ("/plugins/sms/store-cache",
+                   test_sms_store_cache);
+
+  if (g_test_perf ())
+    {
+      g_test_add_func ("/plugins/sms/store-add-perf",
+                       test_sms_store_add_perf);
+      g_test_add_func ("/plugins/sms/store-query-perf",
+                       test_sms_store_query_perf);
+    }
+
   return g_test_run ();
 }
 
@@ -78,11 +78,25 @@ dup_for_phone_cb (ValentContactStore *store,
   g_main_loop_quit (loop);
 }
 
+static void
+remove_contact_cb (ValentContactStore *store,
+                   GAsyncResult       *result,
+                   GMainLoop          *loop)
+{
+  GError *error = NULL;
+
+  valent_contact_store_remove_contacts_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (loop);
+}
+
 static void
 test_sms_contact_from_phone (void)
 {
   g_autoptr (GMainLoop) loop = NULL;
   g_autoptr (ValentContactStore) store = NULL;
+  EContact *contact = NULL;
 
   loop = g_main_loop_new (NULL, FALSE);
   store = valent_test_contact_store_new ();
@@ -96,6 +110,195 @@ test_sms_contact_from_phone (void)
                                  (GAsyncReadyCallback)dup_for_phone_cb,
                                  loop);
   g_main_loop_run (loop);
+
+  VALENT_TEST_CHECK ("Function `valent_sms_contact_lookup_phone()` can look "
+                     "up `EContact`s by phone number.");
+  while (valent_sms_contact_lookup_phone (store, "+1-234-567-8912") == NULL)
+    g_main_context_iteration (NULL, FALSE);
+
+  contact = valent_sms_contact_lookup_phone (store, "(234) 567-8912");
+  g_assert_true (E_IS_CONTACT (contact));
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_UID), ==, "4077i252298cf8ded4bff");
+  g_assert_null (valent_sms_contact_lookup_phone (store, "+1-555-555-5555"));
+
+  VALENT_TEST_CHECK ("The phone number index is updated when contacts are "
+                     "removed.");
+  valent_contact_store_remove_contact (store,
+                                       "4077i252298cf8ded4bff",
+                                       NULL,
+                                       (GAsyncReadyCallback)remove_contact_cb,
+                                       loop);
+  g_main_loop_run (loop);
+
+  while (valent_sms_contact_lookup_phone (store, "+1-234-567-8912") != NULL)
+    g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+add_contacts_cb (ValentContactStore *store,
+                 GAsyncResult       *result,
+                 GMainLoop          *loop)
+{
+  GError *error = NULL;
+
+  valent_contact_store_add_contacts_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (loop);
+}
+
+static void
+query_contacts_cb (ValentContactStore  *store,
+                   GAsyncResult        *result,
+                   GSList             **contacts)
+{
+  GError *error = NULL;
+
+  *contacts = valent_contact_store_query_finish (store, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_sms_contact_lookup_phone (void)
+{
+  g_autoptr (GMainLoop) loop = NULL;
+  g_autoptr (ValentContactStore) store = NULL;
+  GSList *contacts = NULL;
+  EContact *contact = NULL;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  store = valent_test_contact_store_new ();
+
+  while (valent_sms_contact_lookup_phone (store, "+1-234-567-8912") == NULL)
+    g_main_context_iteration (NULL, FALSE);
+
+  VALENT_TEST_CHECK ("Numbers that only share the trailing digits of a "
+                     "contact's number do not match.");
+  g_assert_null (valent_sms_contact_lookup_phone (store, "+1-555-567-8912"));
+  g_assert_null (valent_sms_contact_lookup_phone (store, "+44-20-567-8912"));
+
+  VALENT_TEST_CHECK ("Contact numbers shorter than the index key are matched "
+                     "by suffix.");
+  contact = e_contact_new ();
+  e_contact_set (contact, E_CONTACT_UID, "test-short-number");
+  e_contact_set (contact, E_CONTACT_FULL_NAME, "Short Number");
+  e_contact_set (contact, E_CONTACT_PHONE_MOBILE, "12345");
+  contacts = g_slist_prepend (contacts, contact);
+
+  valent_contact_store_add_contacts (store,
+                                     contacts,
+                                     NULL,
+                                     (GAsyncReadyCallback)add_contacts_cb,
+                                     loop);
+  g_main_loop_run (loop);
+  g_slist_free_full (g_steal_pointer (&contacts), g_object_unref);
+
+  while ((contact = valent_sms_contact_lookup_phone (store, "+1-555-551-2345")) == NULL)
+    g_main_context_iteration (NULL, FALSE);
+
+  g_assert_cmpstr (e_contact_get_const (contact, E_CONTACT_UID), ==, "test-short-number");
+}
+
+static void
+test_sms_contact_lookup_perf (void)
+{
+  g_autoptr (GMainLoop) loop = NULL;
+  g_autoptr (ValentContactStore) store = NULL;
+  g_autoptr (EBookQuery) query = NULL;
+  g_autofree char *sexp = NULL;
+  GSList *contacts = NULL;
+  unsigned int n_contacts = 5000;
+  unsigned int n_threads = 500;
+  unsigned int n_found = 0;
+  double elapsed;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  store = valent_contacts_ensure_store (valent_contacts_get_default (),
+                                        "test-perf-lookup",
+                                        "Test Perf Lookup");
+
+  for (unsigned int i = 0; i < n_contacts; i++)
+    {
+      g_autofree char *uid = g_strdup_printf ("test-perf-contact-%u", i);
+      g_autofree char *name = g_strdup_printf ("Contact %u", i);
+      g_autofree char *number = g_strdup_printf ("+1-555-%03u-%04u",
+                                                 i / 10000, i % 10000);
+      EContact *contact = e_contact_new ();
+
+      e_contact_set (contact, E_CONTACT_UID, uid);
+      e_contact_set (contact, E_CONTACT_FULL_NAME, name);
+      e_contact_set (contact, E_CONTACT_PHONE_MOBILE, number);
+      contacts = g_slist_prepend (contacts, contact);
+    }
+
+  valent_contact_store_add_contacts (store,
+                                     contacts,
+                                     NULL,
+                                     (GAsyncReadyCallback)add_contacts_cb,
+                                     loop);
+  g_main_loop_run (loop);
+  g_slist_free_full (g_steal_pointer (&contacts), g_object_unref);
+
+  /* Scan every contact for each thread, as without an index */
+  g_test_timer_start ();
+  query = e_book_query_field_exists (E_CONTACT_TEL);
+  sexp = e_book_query_to_string (query);
+
+  for (unsigned int i = 0; i < n_threads; i++)
+    {
+      g_autofree char *number = NULL;
+      g_autofree char *normalized = NULL;
+
+      number = g_strdup_printf ("(555) 000-%04u", (i * 7) % n_contacts);
+      normalized = valent_phone_number_normalize (number);
+
+      valent_contact_store_query (store,
+                                  sexp,
+                                  NULL,
+                                  (GAsyncReadyCallback)query_contacts_cb,
+                                  &contacts);
+
+      while (contacts == NULL)
+        g_main_context_iteration (NULL, TRUE);
+
+      for (const GSList *iter = contacts; iter; iter = iter->next)
+        {
+          if (valent_phone_number_of_contact (iter->data, normalized))
+            {
+              n_found++;
+              break;
+            }
+        }
+      g_slist_free_full (g_steal_pointer (&contacts), g_object_unref);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_assert_cmpuint (n_found, ==, n_threads);
+  g_test_message ("scan: %u threads x %u contacts in %.3fs",
+                  n_threads, n_contacts, elapsed);
+
+  /* Look up each thread in the index */
+  while (valent_sms_contact_lookup_phone (store, "+1-555-000-0000") == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  n_found = 0;
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < n_threads; i++)
+    {
+      g_autofree char *number = NULL;
+
+      number = g_strdup_printf ("(555) 000-%04u", (i * 7) % n_contacts);
+
+      if (valent_sms_contact_lookup_phone (store, number) != NULL)
+        n_found++;
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_assert_cmpuint (n_found, ==, n_threads);
+  g_test_minimized_result (elapsed,
+                           "index: %u threads x %u contacts in %.6fs",
+                           n_threads, n_contacts, elapsed);
 }
 
 static void
@@ -146,9 +349,16 @@ main (int   argc,
   g_test_add_func ("/plugins/sms/contact-from-phone",
                    test_sms_contact_from_phone);
 
+  g_test_add_func ("/plugins/sms/contact-lookup-phone",
+                   test_sms_contact_lookup_phone);
+
   g_test_add_func ("/plugins/sms/phone-number",
                    test_sms_phone_number);
 
+  if (g_test_perf ())
+    g_test_add_func ("/plugins/sms/contact-lookup-perf",
+                     test_sms_contact_lookup_perf);
+
   return g_test_run ();
 }
 